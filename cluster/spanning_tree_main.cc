@@ -29,8 +29,25 @@ using namespace std;
 using namespace VW;
 
 int main(int argc, char* argv[])
-{ if (argc > 2)
-  { cout << "usage: spanning_tree [--nondaemon | pid_file]" << endl;
+{ size_t timeout = 0;
+  int port = 26543;
+  const char* port_file = nullptr;
+  while (argc >= 3 && strncmp("--", argv[1], 2) == 0 && strcmp("--nondaemon", argv[1]) != 0)
+  { if (strcmp("--timeout", argv[1]) == 0)
+      timeout = atoi(argv[2]);
+    else if (strcmp("--port", argv[1]) == 0)
+      port = atoi(argv[2]);
+    else if (strcmp("--port_file", argv[1]) == 0)
+      port_file = argv[2];
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+
+  if (argc > 2 || (argc == 2 && strncmp("--", argv[1], 2) == 0 && strcmp("--nondaemon", argv[1]) != 0)
+      || port < 0 || port > 65535)
+  { cout << "usage: spanning_tree [--timeout <seconds>] [--port <port, 0 picks a free one>] [--port_file <file>] [--nondaemon | pid_file]" << endl;
     exit(0);
   }
 
@@ -40,7 +57,18 @@ int main(int argc, char* argv[])
     else if (daemon(1,1))
       THROWERRNO("daemon: ");
 
-    SpanningTree spanningTree;
+    SpanningTree spanningTree(timeout, (short unsigned int)port);
+
+    if (port_file != nullptr)
+    { ofstream port_out;
+      port_out.open(port_file);
+      if (!port_out.is_open())
+      { cerr << "error writing port file" << endl;
+        exit(1);
+      }
+      port_out << spanningTree.BoundPort() << endl;
+      port_out.close();
+    }
 
     if (argc == 2 && strcmp("--nondaemon",argv[1])!=0)
     { ofstream pid_file;
@@ -0,0 +1,89 @@
+// Checks and times AllReduceThreads (vowpalwabbit/allreduce.h), the allreduce of threads in one
+// process.
+//
+//   allreduce_bench [threads] [floats] [rounds]
+//
+// Every thread allocates and fills its own buffer, so that on a NUMA host its pages are placed on
+// the thread's node by first touch, as the weights of a vw instance initialized on its own thread
+// are.  Buffers of 1, threads - 1 and the given number of floats are summed rounds times each and
+// checked against the expected sums, then the throughput of the largest is printed to stderr.
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../vowpalwabbit/allreduce.h"
+
+using namespace std;
+
+void add_float(float& c1, const float& c2) { c1 += c2; }
+
+// small integers, so the float sums are exact whatever order they are added in
+inline float value(size_t node, size_t i, size_t round) { return (float)((node + 1) * ((i + round) % 7)); }
+
+void run(AllReduceThreads* reduce, size_t threads, size_t floats, size_t rounds, bool& good, double& seconds)
+{ vector<float> buffer(floats); // first touched here, by the thread reducing it
+  chrono::steady_clock::duration busy = chrono::steady_clock::duration::zero();
+  for (size_t r = 0; r < rounds; r++)
+  { for (size_t i = 0; i < floats; i++)
+      buffer[i] = value(reduce->node, i, r);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    reduce->all_reduce<float, add_float>(buffer.data(), floats);
+    busy += chrono::steady_clock::now() - start;
+    for (size_t i = 0; i < floats; i++)
+      if (buffer[i] != (float)(threads * (threads + 1) / 2 * ((i + r) % 7)))
+        good = false;
+  }
+  seconds = chrono::duration<double>(busy).count();
+}
+
+int main(int argc, char *argv[])
+{ size_t threads = argc > 1 ? atoi(argv[1]) : 4;
+  size_t floats = argc > 2 ? atoi(argv[2]) : 1 << 22;
+  size_t rounds = argc > 3 ? atoi(argv[3]) : 10;
+  if (threads == 0)
+  { cerr << "usage: allreduce_bench [threads] [floats] [rounds]" << endl;
+    return 1;
+  }
+
+  AllReduceThreads root(threads, 0);
+  vector<AllReduceThreads*> reduces(1, &root);
+  for (size_t t = 1; t < threads; t++)
+    reduces.push_back(new AllReduceThreads(&root, threads, t));
+
+  size_t sizes[] = { 1, threads - 1, floats };
+  bool good = true;
+  double slowest = 0.;
+  for (size_t n : sizes)
+  { vector<char> node_good(threads, 1);
+    vector<double> seconds(threads);
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++)
+      workers.push_back(thread([&, t]()
+      { bool g = true;
+        run(reduces[t], threads, n, rounds, g, seconds[t]);
+        node_good[t] = g;
+      }));
+    for (thread& w : workers)
+      w.join();
+    for (size_t t = 0; t < threads; t++)
+    { if (!node_good[t])
+      { cout << "allreduce_bench: wrong sums of " << n << " floats on thread " << t << endl;
+        good = false;
+      }
+      if (n == floats)
+        slowest = max(slowest, seconds[t]);
+    }
+  }
+
+  for (size_t t = 1; t < threads; t++)
+    delete reduces[t];
+
+  cerr << threads << " threads, " << floats << " floats: " << slowest / rounds * 1e3 << " ms per allreduce, "
+       << (double)threads * floats * sizeof(float) * rounds / slowest / 1e9 << " GB/s of buffers reduced" << endl;
+  if (!good)
+    return 1;
+  cout << "allreduce_bench: OK" << endl;
+  return 0;
+}
@@ -0,0 +1,83 @@
+// Predictions from a vw --daemon over its binary protocol (vowpalwabbit/daemon_client.h).
+//
+//   daemon_predict <host:port> < examples
+//
+// Reads simple-label text examples, "label |ns feature[:value] ... |ns ...", hashes them the way
+// the text parser does and sends them pre-hashed.  Examples are sent in batches of up to 64 before
+// their predictions are read back, one per line in input order.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../vowpalwabbit/daemon_client.h"
+
+using namespace std;
+
+const size_t batch = 64;
+
+void send_line(VW::daemon_client& client, const string& line)
+{ size_t bar = line.find('|');
+  istringstream label(line.substr(0, bar));
+  float l;
+  if (label >> l)
+    client.set_label(l);
+
+  while (bar != string::npos)
+  { size_t next = line.find('|', bar + 1);
+    string space = line.substr(bar + 1, next == string::npos ? string::npos : next - bar - 1);
+    bar = next;
+
+    // a namespace named right after the bar, the default one after a space
+    string name;
+    unsigned char ns = ' ';
+    if (!space.empty() && space[0] != ' ')
+    { name = space.substr(0, space.find(' '));
+      ns = name[0];
+      space = space.substr(name.size());
+    }
+    uint64_t space_hash = client.hash_space(name);
+
+    istringstream features(space);
+    string feature;
+    while (features >> feature)
+    { size_t colon = feature.find(':');
+      float value = colon == string::npos ? 1.f : (float)atof(feature.c_str() + colon + 1);
+      client.add_feature(ns, client.hash_feature(feature.substr(0, colon), space_hash), value);
+    }
+  }
+  client.send_example();
+}
+
+void print_predictions(VW::daemon_client& client)
+{ while (client.outstanding() > 0)
+  { float prediction, raw;
+    client.receive_prediction(prediction, raw);
+    // as vw -p prints them
+    if (floorf(prediction) != prediction)
+      printf("%f\n", prediction);
+    else
+      printf("%.0f\n", prediction);
+  }
+}
+
+int main(int argc, char *argv[])
+{ if (argc < 2)
+  { cerr << "usage: daemon_predict <host:port> [bits] < examples" << endl;
+    return 1;
+  }
+  VW::daemon_client client(argv[1]);
+  string line;
+  while (getline(cin, line))
+  { if (line.empty())
+      continue;
+    send_line(client, line);
+    if (client.outstanding() == batch)
+      print_predictions(client);
+  }
+  client.close();
+  print_predictions(client);
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Top-k recommendations from a matrix factorization model (--rank) over a very large item set.
+//
+// Instead of scoring every user/item pair like recommend does, the items are put in an approximate
+// maximum inner product index (vowpalwabbit/mips.h) over their factors, built once and saved with
+// --index.  For each user only the --candidates items the index returns are scored by the model.
+//
+// A rank model scores a pair as
+//   constant + linear(user) + linear(item) + sum_k l_k(user) r_k(item)
+// so items are indexed as (r_1 .. r_rank, linear(item)) and queried with (l_1 .. l_rank, 1).
+//
+// --bench also searches all items exactly for every user and reports recall@topk of the candidates
+// the model kept, and the time per query of both searches.
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "../vowpalwabbit/vw.h"
+#include "../vowpalwabbit/mips.h"
+
+using namespace std;
+using namespace ACTION_SCORE;
+namespace po = boost::program_options;
+
+// sum over the features of fs of x_f w[f + offset]
+float offset_dot(vw& model, features& fs, size_t offset)
+{ float sum = 0.;
+  for (features::iterator& f : fs)
+    sum += f.value() * model.reg.weight_vector[(f.index() + offset) & model.reg.weight_mask];
+  return sum;
+}
+
+float linear(vw& model, example& ec)
+{ float sum = 0.;
+  for (namespace_index ns : ec.indices)
+    if (ns != constant_namespace)
+      sum += offset_dot(model, ec.feature_space[ns], 0);
+  return sum;
+}
+
+double micros_since(chrono::steady_clock::time_point start)
+{ return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count(); }
+
+int main(int argc, char *argv[])
+{ string userfilename, itemfilename, indexfilename, vwparams;
+  size_t topk = 10, candidates = 100, clusters = 0, probes = 16, iterations = 10;
+
+  po::variables_map vm;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+  ("help,h", "produce help message")
+  ("users,U", po::value<string>(&userfilename), "users portion in vw format to make recs for")
+  ("items,I", po::value<string>(&itemfilename), "items (in vw format) to recommend from")
+  ("vwparams", po::value<string>(&vwparams), "vw parameters for model instantiation (-i model -t ...), the model must use --rank with one pair")
+  ("topk", po::value<size_t>(&topk), "number of items to recommend per user")
+  ("candidates", po::value<size_t>(&candidates), "items per user taken from the index and scored by the model")
+  ("index", po::value<string>(&indexfilename), "load the item index from this file, or build it and save it here")
+  ("clusters", po::value<size_t>(&clusters), "clusters when building the index (default: sqrt of the number of items)")
+  ("probes", po::value<size_t>(&probes), "clusters searched per user")
+  ("iterations", po::value<size_t>(&iterations), "k-means iterations when building the index")
+  ("bench", "compare with an exact search over all items: recall and time per query")
+  ;
+
+  try
+  { po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch(exception & e)
+  { cout << endl << argv[0] << ": " << e.what() << endl << endl << desc << endl;
+    exit(2);
+  }
+
+  if (vm.count("help") || userfilename.empty() || itemfilename.empty() || vwparams.empty())
+  { cout << desc << "\n";
+    cout << "Example usage:" << endl;
+    cout << "    ./mips_recommend -U users -I items --index items.mips --vwparams '-t -i movielens.reg --quiet'" << endl;
+    return 1;
+  }
+  if (topk == 0)
+  { cerr << "mips_recommend: --topk must be at least 1" << endl;
+    exit(2);
+  }
+  candidates = max(candidates, topk);
+  bool bench = vm.count("bench") > 0;
+
+  vw* model = VW::initialize(vwparams);
+  if (model->vm.count("rank") == 0 || model->pairs.size() != 1)
+  { cerr << "mips_recommend needs a --rank model with one pair of namespaces" << endl;
+    exit(2);
+  }
+  size_t rank = model->vm["rank"].as<uint32_t>();
+  unsigned char user_ns = model->pairs[0][0];
+  unsigned char item_ns = model->pairs[0][1];
+  size_t dim = rank + 1;
+
+  // item lines and their vectors
+  vector<string> items;
+  vector<float> vectors;
+  ifstream fI(itemfilename.c_str());
+  if (!fI.is_open())
+  { cerr << "can't open " << itemfilename << endl;
+    exit(2);
+  }
+  for (string line; getline(fI, line);)
+  { example* ec = VW::read_example(*model, line.c_str());
+    for (size_t k = 1; k <= rank; k++)
+      vectors.push_back(offset_dot(*model, ec->feature_space[item_ns], k + rank));
+    vectors.push_back(linear(*model, *ec));
+    VW::finish_example(*model, ec);
+    items.push_back(line);
+  }
+
+  MIPS::index ix;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  ifstream existing(indexfilename.c_str());
+  if (!indexfilename.empty() && existing.is_open())
+  { existing.close();
+    try
+    { MIPS::load(ix, indexfilename);
+    }
+    catch (exception& e)
+    { cerr << e.what() << endl;
+      exit(2);
+    }
+    if (ix.items != items.size() || ix.dim != dim)
+    { cerr << indexfilename << " indexes " << ix.items << " items of rank " << ix.dim - 1 << ", not "
+           << items.size() << " of rank " << rank << endl;
+      exit(2);
+    }
+    if (ix.checksum != MIPS::checksum(vectors))
+    { cerr << indexfilename << " was built for another model or other items: remove it to rebuild it" << endl;
+      exit(2);
+    }
+    cerr << "loaded index of " << ix.cluster_begin.size() - 1 << " clusters in " << micros_since(start) / 1e6 << "s" << endl;
+  }
+  else
+  { if (clusters == 0)
+      clusters = (size_t)sqrt((double)items.size());
+    MIPS::build(ix, vectors, dim, clusters, iterations, 0);
+    cerr << "built index of " << ix.cluster_begin.size() - 1 << " clusters over " << items.size() << " items in "
+         << micros_since(start) / 1e6 << "s" << endl;
+    if (!indexfilename.empty())
+      MIPS::save(ix, indexfilename);
+  }
+
+  ifstream fU(userfilename.c_str());
+  if (!fU.is_open())
+  { cerr << "can't open " << userfilename << endl;
+    exit(2);
+  }
+  vector<float> query(dim);
+  action_scores found = v_init<action_score>();
+  action_scores exact = v_init<action_score>();
+  vector<pair<float, size_t> > scored;
+  size_t users = 0, hits = 0, relevant = 0;
+  double search_us = 0., score_us = 0., exact_us = 0.;
+  for (string user; getline(fU, user);)
+  { users++;
+    example* ec = VW::read_example(*model, user.c_str());
+    for (size_t k = 1; k <= rank; k++)
+      query[k - 1] = offset_dot(*model, ec->feature_space[user_ns], k);
+    query[rank] = 1.;
+    VW::finish_example(*model, ec);
+
+    start = chrono::steady_clock::now();
+    MIPS::top_k(ix, &query[0], candidates, probes, found);
+    search_us += micros_since(start);
+
+    // the model has the last word on the candidates
+    start = chrono::steady_clock::now();
+    scored.clear();
+    for (action_score& a : found)
+    { ec = VW::read_example(*model, (user + " " + items[a.action]).c_str());
+      model->learn(ec);
+      scored.push_back(make_pair(ec->pred.scalar, (size_t)a.action));
+      VW::finish_example(*model, ec);
+    }
+    size_t kept = min(topk, scored.size());
+    partial_sort(scored.begin(), scored.begin() + kept, scored.end(), greater<pair<float, size_t> >());
+    score_us += micros_since(start);
+
+    for (size_t r = 0; r < kept; r++)
+      cout << scored[r].first << '\t' << user << ' ' << items[scored[r].second] << endl;
+
+    if (bench)
+    { start = chrono::steady_clock::now();
+      MIPS::exact_top_k(ix, &query[0], topk, exact);
+      exact_us += micros_since(start);
+      for (action_score& a : exact)
+        for (size_t r = 0; r < kept; r++)
+          if (scored[r].second == a.action)
+            hits++;
+      relevant += exact.size();
+    }
+  }
+
+  if (users > 0)
+  { cerr << users << " users, " << items.size() << " items, " << candidates << " candidates from "
+         << probes << " probes" << endl;
+    cerr << "index search " << search_us / users << " us/user, model scoring " << score_us / users << " us/user" << endl;
+    if (bench)
+      cerr << "exact search " << exact_us / users << " us/user, recall@" << topk << " "
+           << (relevant ? (double)hits / relevant : 1.) << endl;
+  }
+
+  found.delete_v();
+  exact.delete_v();
+  VW::finish(*model);
+  return 0;
+}
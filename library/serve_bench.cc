@@ -0,0 +1,145 @@
+// Load generator for vw --serve.
+//
+//   serve_bench <host:port> <examples file> <id>[,<id>...] [connections] [requests per connection]
+//
+// Every connection sends requests one at a time, cycling through the examples and the model ids,
+// and times each round trip.  Prints client-side QPS and latency percentiles per model, followed by
+// the server's own counters from a "stats" request.
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+int connect_to(const string& host_port)
+{ size_t colon = host_port.find(':');
+  string host = host_port.substr(0, colon);
+  string port = colon == string::npos ? "26542" : host_port.substr(colon + 1);
+  addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+    throw runtime_error("can't resolve " + host_port);
+  int sd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (sd < 0 || connect(sd, res->ai_addr, res->ai_addrlen) < 0)
+    throw runtime_error("can't connect to " + host_port);
+  freeaddrinfo(res);
+  return sd;
+}
+
+struct connection
+{ int sd;
+  string buffered;
+
+  void send_line(const string& line)
+  { string s = line + "\n";
+    for (size_t done = 0; done < s.size();)
+    { ssize_t w = write(sd, s.c_str() + done, s.size() - done);
+      if (w <= 0)
+        throw runtime_error("write failed");
+      done += w;
+    }
+  }
+
+  string read_line()
+  { size_t newline;
+    while ((newline = buffered.find('\n')) == string::npos)
+    { char buf[4096];
+      ssize_t r = read(sd, buf, sizeof(buf));
+      if (r <= 0)
+        throw runtime_error("connection closed");
+      buffered.append(buf, r);
+    }
+    string line = buffered.substr(0, newline);
+    buffered.erase(0, newline + 1);
+    return line;
+  }
+};
+
+void run(const string& host, const vector<string>& examples, const vector<string>& ids, size_t first,
+         size_t requests, map<string, vector<double> >& latencies)
+{ connection c = { connect_to(host), "" };
+  for (size_t i = 0; i < requests; i++)
+  { const string& id = ids[(first + i) % ids.size()];
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    c.send_line(id + " " + examples[(first + i) % examples.size()]);
+    string reply = c.read_line();
+    if (reply.compare(0, 6, "error:") == 0)
+      throw runtime_error(reply);
+    latencies[id].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+  }
+  close(c.sd);
+}
+
+int main(int argc, char* argv[])
+{ if (argc < 4)
+  { cerr << "usage: " << argv[0] << " <host:port> <examples file> <id>[,<id>...] [connections] [requests per connection]" << endl;
+    return 1;
+  }
+  string host = argv[1];
+  size_t connections = argc > 4 ? atoi(argv[4]) : 4;
+  size_t requests = argc > 5 ? atoi(argv[5]) : 10000;
+
+  vector<string> examples;
+  ifstream in(argv[2]);
+  for (string line; getline(in, line);)
+    if (!line.empty())
+      examples.push_back(line);
+  vector<string> ids;
+  stringstream id_list(argv[3]);
+  for (string id; getline(id_list, id, ',');)
+    ids.push_back(id);
+  if (examples.empty() || ids.empty())
+  { cerr << "no examples or no model ids" << endl;
+    return 1;
+  }
+
+  try
+  { vector<map<string, vector<double> > > latencies(connections);
+    vector<thread> clients;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < connections; i++)
+      clients.push_back(thread([&, i] { run(host, examples, ids, i, requests, latencies[i]); }));
+    for (thread& t : clients)
+      t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << connections * requests << " requests over " << connections << " connections in "
+         << seconds << "s: " << connections * requests / seconds << " qps" << endl;
+    cout << "model requests p50_us p99_us max_us" << endl;
+    for (const string& id : ids)
+    { vector<double> all;
+      for (auto& l : latencies)
+        all.insert(all.end(), l[id].begin(), l[id].end());
+      if (all.empty())
+        continue;
+      sort(all.begin(), all.end());
+      cout << id << ' ' << all.size() << ' ' << all[all.size() / 2] << ' '
+           << all[all.size() * 99 / 100] << ' ' << all.back() << endl;
+    }
+
+    connection c = { connect_to(host), "" };
+    c.send_line("stats");
+    cout << "server: model requests qps mean_us max_us" << endl;
+    for (string line; !(line = c.read_line()).empty();)
+      cout << "server: " << line << endl;
+    close(c.sd);
+  }
+  catch (exception& e)
+  { cerr << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/bash
+# -- vw --args test: models trained side by side, each on its own thread, must come out the same
+#    as training them one at a time, whatever the other lines use
+#
+NAME='vw-args-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+ARGSFILE=$NAME.args
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $ARGSFILE model.1 model.2 model.3 model.4 $NAME.model
+}
+
+# -- main
+cleanup
+
+# different weights per feature and random draws (bootstrap, nn, active) on each line
+cat > $ARGSFILE <<EOF2
+-d train-sets/0001.dat --bootstrap 8 --quiet
+-d train-sets/0001.dat --bootstrap 4 --random_seed 7 --quiet
+-d train-sets/0001.dat --nn 3 --random_seed 3 --quiet
+-d train-sets/0001.dat --active --simulation --mellowness 0.01 --quiet
+EOF2
+
+$VW --args $ARGSFILE > /dev/null
+
+status=0
+i=1
+while read -r line; do
+    $VW $line -f $NAME.model
+    if cmp -s model.$i $NAME.model; then
+        echo "$NAME: model.$i OK"
+    else
+        echo "$NAME FAILED: model.$i differs from training '$line' alone"
+        status=1
+    fi
+    i=$((i+1))
+done < $ARGSFILE
+
+if [ $status = 0 ]; then
+    cleanup
+fi
+exit $status
@@ -0,0 +1,57 @@
+#!/bin/bash
+# -- vw --background_save test: checkpoints written from a snapshot while learning goes on are
+#    the same, byte for byte, as the ones learning stops for
+#
+NAME='vw-background-save-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+DATA=$NAME.dat
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $DATA $NAME.*.cache $NAME.*.model*
+}
+
+# -- main
+cleanup
+
+# a tagged save in the middle of each pass, and a save after each pass
+(head -n 100 train-sets/0001.dat
+ echo "save_$NAME.tagged.model|"
+ tail -n +101 train-sets/0001.dat) > $DATA
+
+# (checkpoints in the middle of learning are compared without --save_resume: its example count
+# is advanced by the parser, which reads ahead of learning)
+for mode in foreground background; do
+    args=""
+    [ $mode = background ] && args="--background_save"
+    $VW -d $DATA --cache_file $NAME.$mode.cache -k --passes 3 --holdout_off --save_per_pass \
+        -f $NAME.$mode.model $args --quiet
+    # tagged saves get pass number 0, the last pass overwrote the first ones
+    mv $NAME.tagged.model.0 $NAME.$mode.model.tagged
+done
+
+status=0
+for suffix in .tagged .0 .1 .2 ""; do
+    if cmp -s $NAME.foreground.model$suffix $NAME.background.model$suffix; then
+        echo "$NAME: model$suffix OK"
+    else
+        echo "$NAME FAILED: model$suffix differs from a foreground save"
+        status=1
+    fi
+done
+
+if [ $status = 0 ]; then
+    cleanup
+fi
+exit $status
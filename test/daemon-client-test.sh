@@ -0,0 +1,72 @@
+#!/bin/bash
+# -- daemon_client test: predictions of a --daemon for examples sent pre-hashed by
+#    library/daemon_predict match those of vw -t on the text examples, whatever the -b of the daemon
+#
+NAME='vw-daemon-client-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+CLIENT=../library/daemon_predict
+
+MODEL=$NAME.model
+PORTFILE=$NAME.port
+PIDFILE=$NAME.pid
+PREDREF=$NAME.predref
+PREDOUT=$NAME.predict
+
+# -- make sure we can find vw and the client first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+if [ -x "$CLIENT" ]; then
+    : cool found the client at: $CLIENT
+else
+    echo "$NAME: can not find $CLIENT - build it with 'make library_example'"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $MODEL $PORTFILE $PIDFILE $PREDREF $PREDOUT
+}
+
+# -- main
+cleanup
+
+# the predictions of a daemon for the examples of a model trained with the given options
+predict() {
+    $VW --quiet -d $DATA -q ff "$@" -f $MODEL
+    $VW -t -i $MODEL -d $DATA -p /dev/stdout --quiet | cat >> $PREDREF
+
+    /bin/rm -f $PORTFILE $PIDFILE
+    $VW -t -i $MODEL --daemon --num_children 1 --quiet --port 0 --port_file $PORTFILE --pid_file $PIDFILE \
+        </dev/null >/dev/null 2>&1
+    until [ -s $PIDFILE ]; do sleep 0.1; done
+
+    $CLIENT localhost:`cat $PORTFILE` < $DATA >> $PREDOUT
+
+    kill -TERM `cat $PIDFILE`
+}
+
+# quadratic features of a named namespace, and more examples than one batch of the client
+DATA=train-sets/0001.dat
+predict
+predict -b 24
+
+# We should ignore small (< $Epsilon) floating-point differences (fuzzy compare)
+diff <(cut -c-5 $PREDREF) <(cut -c-5 $PREDOUT)
+case $? in
+    0)  echo "$NAME: OK"
+        cleanup
+        exit 0
+        ;;
+    1)  echo "$NAME FAILED: see $PREDREF vs $PREDOUT"
+        exit 1
+        ;;
+    *)  echo "$NAME: diff failed - something is fishy"
+        exit 2
+        ;;
+esac
@@ -0,0 +1,60 @@
+#!/bin/bash
+# -- vw --delta_checkpoints test: a chain of deltas loads on top of its base, and each delta
+#    refuses any other model, the final one of the same run included
+#
+NAME='vw-delta-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+MODEL=$NAME.model
+OTHER=$NAME.other.model
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $MODEL $MODEL.0 $MODEL.1 $MODEL.2 $OTHER $NAME.cache
+}
+
+status=0
+
+# load: -i followed by deltas, and whether vw should take them
+check() {
+    expected=$1
+    shift
+    if $VW -t --quiet -d train-sets/0001.dat "$@" 2>&1 | grep -q "doesn't apply to the model loaded so far"; then
+        result=refused
+    else
+        result=loaded
+    fi
+    if [ $result = $expected ]; then
+        echo "$NAME: $expected $* OK"
+    else
+        echo "$NAME FAILED: $result $*"
+        status=1
+    fi
+}
+
+# -- main
+cleanup
+
+$VW --quiet -d train-sets/0001.dat -c --cache_file $NAME.cache --passes 3 --holdout_off --save_per_pass --delta_checkpoints -f $MODEL
+$VW --quiet -d train-sets/0001.dat -l 2 -f $OTHER
+
+check loaded -i $MODEL.0 -i $MODEL.1 -i $MODEL.2
+check refused -i $MODEL.0 -i $MODEL.2
+check refused -i $MODEL.0 -i $MODEL.2 -i $MODEL.1
+check refused -i $MODEL -i $MODEL.1
+check refused -i $OTHER -i $MODEL.1
+
+if [ $status = 0 ]; then
+    cleanup
+fi
+exit $status
@@ -0,0 +1,110 @@
+#!/bin/bash
+# -- mips_recommend test: searching every cluster of the index finds the same top items as scoring
+#    every item with vw, and a saved index is refused for another model or when corrupt
+#
+NAME='vw-mips-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+RECOMMEND=../library/mips_recommend
+
+# -- make sure we can find vw and mips_recommend first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+if [ -x "$RECOMMEND" ]; then
+    : cool found mips_recommend at: $RECOMMEND
+else
+    echo "$NAME: can not find $RECOMMEND - build it with 'make library_example'"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $NAME.model $NAME.other.model $NAME.users $NAME.items $NAME.pairs $NAME.index $NAME.corrupt.index \
+        $NAME.predref $NAME.predict $NAME.stderr
+}
+
+status=0
+result() {
+    if [ "$2" = OK ]; then
+        echo "$NAME: $1 OK"
+    else
+        echo "$NAME FAILED: $1: $2"
+        status=1
+    fi
+}
+
+# -- main
+cleanup
+
+DATA=train-sets/ml100k_small_train
+$VW --quiet -d $DATA -b 16 -q ui --rank 4 --l2 2e-6 --learning_rate 0.05 --power_t 0 --loss_function classic -f $NAME.model
+$VW --quiet -d $DATA -b 16 -q ui --rank 4 --l2 2e-6 --learning_rate 0.1 --power_t 0 --loss_function classic -f $NAME.other.model
+
+for u in 1 5 6 13 42; do echo "|u $u"; done > $NAME.users
+awk '{print "|i " $5}' $DATA | sort -u > $NAME.items
+
+# top 5 items of each user by the score vw gives every pair
+while read -r user; do
+    sed "s/^/$user /" $NAME.items
+done < $NAME.users > $NAME.pairs
+$VW -t -i $NAME.model -d $NAME.pairs -p /dev/stdout --quiet | paste - $NAME.pairs \
+    | awk -F'\t' -v n=`wc -l < $NAME.items` '{ print int((NR - 1) / n) "\t" $1 "\t" $2 }' \
+    | sort -t$'\t' -k1,1n -k2,2gr | awk -F'\t' '++seen[$1] <= 5 { print $3 }' > $NAME.predref
+
+# all 12 clusters probed: the index returns the exact top items
+$RECOMMEND -U $NAME.users -I $NAME.items --vwparams "-t -i $NAME.model --quiet" --index $NAME.index \
+    --topk 5 --candidates 5 --clusters 12 --probes 12 --bench 2> $NAME.stderr | cut -f2 > $NAME.predict
+if ! diff -q $NAME.predref $NAME.predict > /dev/null; then
+    result "probes == clusters" "see $NAME.predref vs $NAME.predict"
+elif ! grep -q "recall@5 1$" $NAME.stderr; then
+    result "probes == clusters" "recall below 1"
+else
+    result "probes == clusters" OK
+fi
+
+# the saved index is reused for the same model, and refused for another one
+$RECOMMEND -U $NAME.users -I $NAME.items --vwparams "-t -i $NAME.model --quiet" --index $NAME.index \
+    --topk 5 --candidates 5 --probes 12 2> $NAME.stderr | cut -f2 > $NAME.predict
+if grep -q "loaded index" $NAME.stderr && diff -q $NAME.predref $NAME.predict > /dev/null; then
+    result "saved index" OK
+else
+    result "saved index" "not loaded, or different results"
+fi
+$RECOMMEND -U $NAME.users -I $NAME.items --vwparams "-t -i $NAME.other.model --quiet" --index $NAME.index \
+    --topk 5 --candidates 5 --probes 12 > /dev/null 2> $NAME.stderr
+if grep -q "was built for another model" $NAME.stderr; then
+    result "index of another model" OK
+else
+    result "index of another model" "not refused"
+fi
+
+# a cluster table that does not end at the number of items, and an absurd vector size
+cp $NAME.index $NAME.corrupt.index
+printf '\x01' | dd of=$NAME.corrupt.index bs=1 seek=$((36 + 8 + 12 * 5 * 4 + 8 + 12 * 4)) conv=notrunc 2>/dev/null
+$RECOMMEND -U $NAME.users -I $NAME.items --vwparams "-t -i $NAME.model --quiet" --index $NAME.corrupt.index \
+    --topk 5 --candidates 5 --probes 12 > /dev/null 2> $NAME.stderr
+grep -q "is truncated or corrupt" $NAME.stderr && corrupt=OK || corrupt="cluster table not checked"
+cp $NAME.index $NAME.corrupt.index
+printf '\xff\xff\xff\xff\xff\xff\xff\x7f' | dd of=$NAME.corrupt.index bs=1 seek=36 conv=notrunc 2>/dev/null
+$RECOMMEND -U $NAME.users -I $NAME.items --vwparams "-t -i $NAME.model --quiet" --index $NAME.corrupt.index \
+    --topk 5 --candidates 5 --probes 12 > /dev/null 2> $NAME.stderr
+grep -q "is truncated or corrupt" $NAME.stderr || corrupt="vector size not checked"
+result "corrupt index" "$corrupt"
+
+$RECOMMEND -U $NAME.users -I $NAME.items --vwparams "-t -i $NAME.model --quiet" --topk 0 --candidates 0 \
+    > /dev/null 2> $NAME.stderr
+if grep -q "topk must be at least 1" $NAME.stderr; then
+    result "--topk 0" OK
+else
+    result "--topk 0" "not refused"
+fi
+
+if [ $status = 0 ]; then
+    cleanup
+fi
+exit $status
@@ -0,0 +1,128 @@
+#!/bin/bash
+# -- vw --daemon SIGHUP test: a reload swaps in new weights, keeps the weights of a learning
+#    daemon shared by its children, and is refused for a model with state outside the weights
+#
+NAME='vw-reload-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+MODEL=$NAME.model
+PORTFILE=$NAME.port
+PIDFILE=$NAME.pid
+ERRFILE=$NAME.stderr
+PREDREF=$NAME.predref
+PREDOUT=$NAME.predict
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $MODEL $PORTFILE $PIDFILE $ERRFILE $PREDREF $PREDOUT $NAME.a.model $NAME.b.model $NAME.c.model $NAME.ksvm.model
+}
+
+start_daemon() {
+    /bin/rm -f $PORTFILE $PIDFILE
+    $VW -i $MODEL "$@" --daemon --quiet --port 0 --port_file $PORTFILE --pid_file $PIDFILE \
+        </dev/null >/dev/null 2>>$ERRFILE
+    until [ -s $PIDFILE ]; do sleep 0.1; done
+}
+
+stop_daemon() {
+    kill -TERM `cat $PIDFILE`
+    while kill -0 `cat $PIDFILE` 2>/dev/null; do sleep 0.1; done
+}
+
+# the predictions of the daemon for the first 3 examples of a data file
+query() {
+    exec 3<>/dev/tcp/localhost/`cat $PORTFILE`
+    head -3 $1 >&3
+    for i in 1 2 3; do
+        read -r line <&3
+        echo "$line"
+    done
+    exec 3>&-
+}
+
+# the same from a test-only run of a model file
+expected() {
+    model=$1 data=$2
+    shift 2
+    head -3 $data | $VW -t -i $model "$@" -p /dev/stdout --quiet 2>/dev/null | cat
+}
+
+reload() {
+    kill -HUP `cat $PIDFILE`
+    sleep 0.5
+}
+
+# -- main
+cleanup
+
+$VW -b 10 --quiet -d train-sets/0001.dat -f $NAME.a.model
+$VW -b 10 --quiet -d train-sets/0001.dat -l 10 -f $NAME.b.model
+$VW --quiet -d train-sets/rcv1_smaller.dat --ksvm --l2 1 -f $NAME.ksvm.model 2>/dev/null
+
+# weights: before and after the reload
+cp $NAME.a.model $MODEL
+start_daemon -t --num_children 1
+(expected $NAME.a.model train-sets/0001.dat
+ expected $NAME.b.model train-sets/0001.dat) > $PREDREF
+query train-sets/0001.dat > $PREDOUT
+cp $NAME.b.model $MODEL
+reload
+query train-sets/0001.dat >> $PREDOUT
+stop_daemon
+
+# a learning daemon: after the reload, what one child learns is seen by the other
+head -50 train-sets/0001.dat | $VW --quiet -i $NAME.b.model -f $NAME.c.model
+head -3 train-sets/0001.dat | cut -d'|' -f2- | sed 's/^/|/' > $NAME.unlabeled
+expected $NAME.c.model $NAME.unlabeled >> $PREDREF
+cp $NAME.a.model $MODEL
+start_daemon --num_children 2
+cp $NAME.b.model $MODEL
+reload
+port=`cat $PORTFILE`
+exec 3<>/dev/tcp/localhost/$port 4<>/dev/tcp/localhost/$port
+head -50 train-sets/0001.dat >&3
+for i in `seq 50`; do read -r line <&3; done
+cat $NAME.unlabeled >&4
+for i in 1 2 3; do
+    read -r line <&4
+    echo "$line" >> $PREDOUT
+done
+exec 3>&- 4>&-
+/bin/rm -f $NAME.unlabeled
+stop_daemon
+
+# ksvm keeps its support vectors outside the weights: the running model stays
+# (its regularization is not saved in the model)
+cp $NAME.ksvm.model $MODEL
+start_daemon -t --num_children 1 --l2 1
+expected $NAME.ksvm.model train-sets/rcv1_smaller.dat --l2 1 >> $PREDREF
+cp $NAME.a.model $MODEL
+reload
+query train-sets/rcv1_smaller.dat >> $PREDOUT
+stop_daemon
+grep -q "model reload: --ksvm keeps model state outside the weights" $ERRFILE || echo "no ksvm reload refusal" >> $PREDOUT
+
+# We should ignore small (< $Epsilon) floating-point differences (fuzzy compare)
+diff <(cut -c-5 $PREDREF) <(cut -c-5 $PREDOUT)
+case $? in
+    0)  echo "$NAME: OK"
+        cleanup
+        exit 0
+        ;;
+    1)  echo "$NAME FAILED: see $PREDREF vs $PREDOUT"
+        exit 1
+        ;;
+    *)  echo "$NAME: diff failed - something is fishy"
+        exit 2
+        ;;
+esac
@@ -0,0 +1,72 @@
+#!/bin/bash
+# -- --sendto test: pipelined sending (--sendto_batch, --sendto_window) to a --daemon gets the
+#    predictions of lockstep sending, and reports its throughput and round trip latency
+#
+NAME='vw-sendto-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+MODEL=$NAME.model
+PORTFILE=$NAME.port
+PIDFILE=$NAME.pid
+ERRFILE=$NAME.stderr
+PREDREF=$NAME.predref
+PREDOUT=$NAME.predict
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $MODEL $PORTFILE $PIDFILE $ERRFILE $PREDREF $PREDOUT
+}
+
+status=0
+result() {
+    if [ "$2" = OK ]; then
+        echo "$NAME: $1 OK"
+    else
+        echo "$NAME FAILED: $1: $2"
+        status=1
+    fi
+}
+
+# -- main
+cleanup
+
+# more examples than a few windows, so the window fills up and drains many times
+DATA=train-sets/0001.dat
+$VW --quiet -d $DATA -q ff -f $MODEL
+
+$VW -t -i $MODEL --daemon --num_children 1 --quiet --port 0 --port_file $PORTFILE --pid_file $PIDFILE \
+    </dev/null >/dev/null 2>&1
+until [ -s $PIDFILE ]; do sleep 0.1; done
+HOST=localhost:`cat $PORTFILE`
+
+$VW -d $DATA --sendto $HOST -p $PREDREF --quiet
+$VW -d $DATA --sendto $HOST --sendto_batch 8 --sendto_window 32 -p $PREDOUT 2> $ERRFILE
+
+kill -TERM `cat $PIDFILE`
+
+if diff -q $PREDREF $PREDOUT > /dev/null; then
+    result "pipelined predictions" OK
+else
+    result "pipelined predictions" "see $PREDREF vs $PREDOUT"
+fi
+if grep -q "^sendto: 200 examples in .* batches, .* examples/sec$" $ERRFILE \
+    && grep -q "^sendto: round trip latency mean .* ms, max .* ms$" $ERRFILE; then
+    result "pipelined stats" OK
+else
+    result "pipelined stats" "not in $ERRFILE"
+fi
+
+if [ $status = 0 ]; then
+    cleanup
+fi
+exit $status
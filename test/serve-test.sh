@@ -0,0 +1,84 @@
+#!/bin/bash
+# -- vw --serve test: two models behind one port, answered on two connections that stay open
+#    while a single handler thread serves them
+#
+NAME='vw-serve-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+MODELS=$NAME.models
+PORTFILE=$NAME.port
+PREDREF=$NAME.predref
+PREDOUT=$NAME.predict
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $MODELS $PORTFILE $PREDREF $PREDOUT $NAME.simple.model $NAME.oaa.model
+}
+
+# -- main
+cleanup
+
+$VW -b 10 --quiet -d train-sets/0001.dat -f $NAME.simple.model
+$VW -b 10 --quiet -d train-sets/multiclass --oaa 10 -f $NAME.oaa.model
+
+cat > $MODELS <<EOF
+# id  arguments
+simple -t -i $NAME.simple.model
+oaa -t -i $NAME.oaa.model
+EOF
+
+# prepare expected predict output: the same as running each model on its own
+(head -3 train-sets/0001.dat | $VW -t -i $NAME.simple.model -p /dev/stdout --quiet | cat
+ head -3 train-sets/multiclass | $VW -t -i $NAME.oaa.model -p /dev/stdout --quiet | cat
+ echo 'error: unknown model nosuchmodel') > $PREDREF
+
+$VW --serve $MODELS --port 0 --port_file $PORTFILE --threads 1 2>/dev/null &
+SERVER=$!
+until [ -s $PORTFILE ]; do sleep 0.1; done
+
+# read_replies <fd> <count>: a reply that does not come within 5 seconds is missing
+read_replies() {
+    for i in `seq $2`; do
+        read -t 5 -r line <&$1 || line="no reply"
+        echo "$line"
+    done
+}
+
+# bash opens the TCP connections itself, so no netcat is needed
+exec 3<>/dev/tcp/localhost/`cat $PORTFILE`
+exec 4<>/dev/tcp/localhost/`cat $PORTFILE`
+(head -3 train-sets/0001.dat | sed 's/^/simple /') >&3
+read_replies 3 3 > $PREDOUT
+(head -3 train-sets/multiclass | sed 's/^/oaa /') >&4
+read_replies 4 3 >> $PREDOUT
+echo 'nosuchmodel 1 | a' >&3
+read_replies 3 1 >> $PREDOUT
+exec 3>&- 4>&-
+
+kill -TERM $SERVER
+wait $SERVER
+
+# We should ignore small (< $Epsilon) floating-point differences (fuzzy compare)
+diff <(cut -c-5 $PREDREF) <(cut -c-5 $PREDOUT)
+case $? in
+    0)  echo "$NAME: OK"
+        cleanup
+        exit 0
+        ;;
+    1)  echo "$NAME FAILED: see $PREDREF vs $PREDOUT"
+        exit 1
+        ;;
+    *)  echo "$NAME: diff failed - something is fishy"
+        exit 2
+        ;;
+esac
@@ -0,0 +1,135 @@
+#!/bin/bash
+# -- spanning tree test: a node that dies fails the others fast, a stopped node fails the others
+#    after --allreduce_timeout, a node that dies while waiting can rejoin, and --timeout releases
+#    nodes nobody joined
+#
+NAME='vw-spanning-tree-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+SPANNING_TREE=../cluster/spanning_tree
+
+# -- make sure we can find vw and the span server first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+if [ -x "$SPANNING_TREE" ]; then
+    : cool found the span server at: $SPANNING_TREE
+else
+    echo "$NAME: can not find $SPANNING_TREE - build it with 'make spanning_tree'"
+    exit 1
+fi
+
+cleanup() {
+    /bin/rm -f $NAME.head $NAME.tail $NAME.port $NAME.*.cache $NAME.*.stderr
+}
+
+status=0
+result() {
+    if [ "$2" = OK ]; then
+        echo "$NAME: $1 OK"
+    else
+        echo "$NAME FAILED: $1: $2"
+        status=1
+    fi
+}
+
+# node <unique_id> <node> <data> [args]: one of two nodes, in the background
+node() {
+    id=$1 n=$2 data=$3
+    shift 3
+    $VW --total 2 --node $n --unique_id $id -d $data -c --cache_file $NAME.$id.$n.cache -k --holdout_off \
+        --span_server localhost:$PORT "$@" 2> $NAME.$id.$n.stderr &
+}
+
+# -- main
+cleanup
+# nodes log to their own files: keep the notices of the shell about killed ones out of the output
+exec 2>/dev/null
+head -n 100 train-sets/0001.dat > $NAME.head
+tail -n 100 train-sets/0001.dat > $NAME.tail
+
+$SPANNING_TREE --timeout 3 --port 0 --port_file $NAME.port --nondaemon > /dev/null 2>&1 &
+SERVER=$!
+trap "kill $SERVER 2>/dev/null" EXIT
+for i in `seq 50`; do
+    [ -s $NAME.port ] && break
+    sleep 0.1
+done
+PORT=`cat $NAME.port`
+
+# a node killed while training: the other one stops with an error instead of hanging
+node 1 0 $NAME.head --passes 100000
+NODE0=$!
+node 1 1 $NAME.tail --passes 100000
+NODE1=$!
+sleep 2
+kill -9 $NODE1
+wait $NODE1
+SECONDS=0
+wait $NODE0
+if [ $SECONDS -gt 10 ]; then
+    result "killed node" "the other node took $SECONDS seconds to stop"
+elif grep -q "^vw (allreduce" $NAME.1.0.stderr; then
+    result "killed node" OK
+else
+    result "killed node" "the other node did not report an error"
+fi
+
+# a stopped node: the other one gives up on it after --allreduce_timeout
+node 4 0 $NAME.head --passes 100000 --allreduce_timeout 2
+NODE0=$!
+node 4 1 $NAME.tail --passes 100000 --allreduce_timeout 2
+NODE1=$!
+sleep 2
+kill -STOP $NODE1
+SECONDS=0
+wait $NODE0
+if [ $SECONDS -gt 10 ]; then
+    result "stopped node" "the other node took $SECONDS seconds to stop"
+elif grep -q "stopped or too slow" $NAME.4.0.stderr; then
+    result "stopped node" OK
+else
+    result "stopped node" "the other node did not report the timeout"
+fi
+kill -9 $NODE1
+wait $NODE1
+
+# a node killed while waiting for the other one is dropped and can start again
+node 2 0 $NAME.head --passes 3
+sleep 0.5
+kill -9 $!
+wait $!
+sleep 2
+node 2 0 $NAME.head --passes 3
+NODE0=$!
+node 2 1 $NAME.tail --passes 3
+NODE1=$!
+wait $NODE0 $NODE1
+loss0=`grep "^average loss" $NAME.2.0.stderr`
+loss1=`grep "^average loss" $NAME.2.1.stderr`
+if [ -n "$loss0" -a "$loss0" = "$loss1" ]; then
+    result "rejoined node" OK
+else
+    result "rejoined node" "'$loss0' vs '$loss1'"
+fi
+
+# a lone node is released after the timeout of the span server
+SECONDS=0
+$VW --total 2 --node 0 --unique_id 3 -d $NAME.head --span_server localhost:$PORT --quiet 2> $NAME.3.0.stderr
+if [ $SECONDS -gt 10 ]; then
+    result "timeout" "the lone node waited $SECONDS seconds"
+elif grep -q "gave up on the other nodes" $NAME.3.0.stderr; then
+    result "timeout" OK
+else
+    result "timeout" "the lone node did not report the timeout"
+fi
+
+if [ $status = 0 ]; then
+    cleanup
+fi
+exit $status
@@ -7,6 +7,7 @@ license as described in the file LICENSE.
 
 #pragma once
 #include <string>
+#include <algorithm>
 #ifdef _WIN32
 #include <WinSock2.h>
 #include <WS2tcpip.h>
@@ -21,9 +22,8 @@ namespace std
 template<typename T>
 class promise;
 
-class condition_variable;
-
-class mutex;
+template<typename T>
+struct atomic;
 }
 #else
 #include <sys/socket.h>
@@ -38,6 +38,7 @@ class mutex;
 typedef int socket_t;
 #define CLOSESOCK close
 #include <future>
+#include <atomic>
 #endif
 #include "vw_exception.h"
 #include <assert.h>
@@ -46,6 +47,11 @@ using namespace std;
 
 const size_t ar_buf_size = 1<<16;
 
+// a write to a node that died returns EPIPE instead of killing the writer with SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 
 struct node_socks
 { std::string current_master;
@@ -95,33 +101,38 @@ struct Data
 class AllReduceSync
 {
 private:
-  mutex* m_mutex;
-  condition_variable* m_cv;
-
   // total number of threads we wait for
   size_t m_total;
 
   // number of threads reached the barrier
-  uint32_t m_count;
+  atomic<size_t>* m_count;
 
-  // current wait-barrier-run required to protect against spurious wakeups of m_cv->wait(...)
-  bool m_run;
+  // flipped by the last thread to arrive; waiters spin until it matches their local sense
+  atomic<bool>* m_sense;
 
 public:
   AllReduceSync(const size_t total);
 
   ~AllReduceSync();
 
-  void waitForSynchronization();
+  // sense-reversing barrier, local_sense is owned by the calling thread
+  void waitForSynchronization(bool& local_sense);
 
   void** buffers;
 };
 
+// The buffers reduced are the callers', and stay where the thread that first wrote them placed them:
+// on a NUMA host, initialize each instance on the thread that trains it.  Each thread reduces one
+// slice of all buffers, so only a slice per thread crosses nodes.
 class AllReduceThreads : public AllReduce
 {
 private:
   AllReduceSync* m_sync;
   bool m_syncOwner;
+  bool m_sense;
+
+  // elements reduced and broadcast at a time, small enough to stay in cache between the two
+  static const size_t chunk_bytes = 1 << 15;
 
 public:
   AllReduceThreads(AllReduceThreads* root, const size_t ptotal, const size_t pnode);
@@ -134,40 +145,29 @@ public:
   { // register buffer
     T** buffers = (T**)m_sync->buffers;
     buffers[node] = buffer;
-    m_sync->waitForSynchronization();
+    m_sync->waitForSynchronization(m_sense);
 
-    size_t blockSize = n / total;
-    size_t index;
-    size_t end;
-
-    if (blockSize == 0)
-    { if (node < n)
-      { index = node;
-        end = node + 1;
-      }
-      else
-      { // more threads than bytes --> don't do any work
-        index = end = 0;
-      }
-    }
-    else
-    { index = node * blockSize;
-      end = node == total - 1 ? n : (node + 1) * blockSize;
-    }
+    // every node reduces a disjoint slice, rounded to cache lines so no two nodes write the same line
+    const size_t line = 64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1;
+    size_t blockSize = ((n + total - 1) / total + line - 1) / line * line;
+    size_t index = min(n, node * blockSize);
+    size_t end = node == total - 1 ? n : min(n, (node + 1) * blockSize);
 
-    for (; index < end; index++)
-    { // Perform transposed AllReduce to help data locallity
-      T& first = buffers[0][index];
+    const size_t chunk = chunk_bytes / sizeof(T) > 0 ? chunk_bytes / sizeof(T) : 1;
+    for (; index < end; index += chunk)
+    { size_t len = min(chunk, end - index);
+      T* first = buffers[0] + index;
 
+      // contiguous per-buffer passes vectorize, unlike striding across buffers per element
       for (size_t i = 1; i < total; i++)
-        f(first, buffers[i][index]);
+        addbufs<T, f>(first, buffers[i] + index, len);
 
       // Broadcast back
       for (size_t i = 1; i < total; i++)
-        buffers[i][index] = first;
+        std::copy(first, first + len, buffers[i] + index);
     }
 
-    m_sync->waitForSynchronization();
+    m_sync->waitForSynchronization(m_sense);
   }
 };
 
@@ -177,15 +177,19 @@ private:
   node_socks socks;
   std::string span_server;
   size_t unique_id; //unique id for each node in the network, id == 0 means extra io.
+  size_t timeout; //seconds to wait for another node before giving up on it, 0 waits forever
 
   void all_reduce_init();
+  void set_timeout(socket_t sock);
 
   template <class T> void pass_up(char* buffer, size_t left_read_pos, size_t right_read_pos, size_t& parent_sent_pos)
   { size_t my_bufsize = min(ar_buf_size, min(left_read_pos, right_read_pos) / sizeof(T) * sizeof(T) - parent_sent_pos);
 
     if (my_bufsize > 0)
     { //going to pass up this chunk of data to the parent
-      int write_size = send(socks.parent, buffer + parent_sent_pos, (int)my_bufsize, 0);
+      int write_size = send(socks.parent, buffer + parent_sent_pos, (int)my_bufsize, MSG_NOSIGNAL);
+      if (write_size < 0 && timed_out())
+        THROW("the parent took no data for " << timeout << " seconds, it is stopped or too slow");
       if (write_size < 0)
         THROW("Write to parent failed " << my_bufsize << " " << write_size << " " << parent_sent_pos << " " << left_read_pos << " " << right_read_pos);
 
@@ -225,8 +229,12 @@ private:
       if (parent_sent_pos >= n && child_read_pos[0] >= n && child_read_pos[1] >= n) break;
 
       if (child_read_pos[0] < n || child_read_pos[1] < n)
-      { if (max_fd > 0 && select((int)max_fd, &fds, nullptr, nullptr, nullptr) == -1)
+      { timeval wait = { (long)timeout, 0 };
+        int ready = max_fd > 0 ? select((int)max_fd, &fds, nullptr, nullptr, timeout > 0 ? &wait : nullptr) : 0;
+        if (ready == -1)
           THROWERRNO("select");
+        if (ready == 0 && max_fd > 0)
+          THROW("a child sent no data for " << timeout << " seconds, it is stopped or too slow");
 
         for(int i = 0; i < 2; i++)
         { if(socks.children[i] != -1 && FD_ISSET(socks.children[i],&fds))
@@ -239,6 +247,8 @@ private:
             int read_size = recv(socks.children[i], child_read_buf[i] + child_unprocessed[i], (int)count, 0);
             if (read_size == -1)
               THROWERRNO("recv from child");
+            if (read_size == 0)
+              THROW("child " << i << " closed the connection");
 
             addbufs<T, f>((T*)buffer + child_read_pos[i] / sizeof(T), (T*)child_read_buf[i], (child_read_pos[i] + read_size) / sizeof(T) - child_read_pos[i] / sizeof(T));
 
@@ -261,12 +271,14 @@ private:
     }
   }
 
+  bool timed_out();
   void pass_down(char* buffer, const size_t parent_read_pos, size_t& children_sent_pos);
   void broadcast(char* buffer, const size_t n);
 
 public:
-  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode)
-    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id)
+  // pspan_server is host or host:port, ptimeout in seconds
+  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode, size_t ptimeout = 0)
+    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id), timeout(ptimeout)
   {
   }
 
@@ -30,6 +30,24 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 
 using namespace std;
 
+// Probe idle peers so that a crashed node is noticed within a minute rather than hours.
+void set_keepalive(socket_t sock)
+{ int enableTKA = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (char*)&enableTKA, sizeof(enableTKA)) < 0)
+    cerr << "setsockopt SO_KEEPALIVE: " << strerror(errno) << endl;
+#ifdef TCP_KEEPIDLE
+  int idle = 30, interval = 5, probes = 6;
+  setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, (char*)&idle, sizeof(idle));
+  setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, (char*)&interval, sizeof(interval));
+  setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, (char*)&probes, sizeof(probes));
+#endif
+#ifdef SO_NOSIGPIPE
+  // where send has no MSG_NOSIGNAL
+  int on = 1;
+  setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, (char*)&on, sizeof(on));
+#endif
+}
+
 // port is already in network order
 socket_t sock_connect(const uint32_t ip, const int port)
 {
@@ -72,6 +90,7 @@ socket_t sock_connect(const uint32_t ip, const int port)
   }
   if (ret == -1)
     THROW("cannot connect");
+  set_keepalive(sock);
   return sock;
 }
 
@@ -89,9 +108,7 @@ socket_t getsock()
 #endif
 
   // Enable TCP Keep Alive to prevent socket leaks
-  int enableTKA = 1;
-  if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (char*)&enableTKA, sizeof(enableTKA)) < 0)
-    cerr << "setsockopt SO_KEEPALIVE: " << strerror(errno) << endl;
+  set_keepalive(sock);
 
   return sock;
 }
@@ -106,30 +123,39 @@ void AllReduceSockets::all_reduce_init()
 
 
 
-  struct hostent* master = gethostbyname(span_server.c_str());
+  string host = span_server;
+  int port = 26543;
+  size_t colon = span_server.find(':');
+  if (colon != string::npos)
+  { host = span_server.substr(0, colon);
+    port = atoi(span_server.c_str() + colon + 1);
+    if (port <= 0 || port > 65535)
+      THROW("--span_server " << span_server << ": bad port");
+  }
+
+  struct hostent* master = gethostbyname(host.c_str());
 
   if (master == nullptr)
-    THROWERRNO("gethostbyname(" << span_server << ")");
+    THROWERRNO("gethostbyname(" << host << ")");
 
   socks.current_master = span_server;
 
   uint32_t master_ip = * ((uint32_t*)master->h_addr);
-  int port = 26543;
 
   socket_t master_sock = sock_connect(master_ip, htons(port));
-  if(send(master_sock, (const char*)&unique_id, sizeof(unique_id), 0) < (int)sizeof(unique_id))
+  if(send(master_sock, (const char*)&unique_id, sizeof(unique_id), MSG_NOSIGNAL) < (int)sizeof(unique_id))
     cerr << "write unique_id=" << unique_id << " failed!" << endl;
   else cerr << "wrote unique_id=" << unique_id << endl;
-  if(send(master_sock, (const char*)&total, sizeof(total), 0) < (int)sizeof(total))
+  if(send(master_sock, (const char*)&total, sizeof(total), MSG_NOSIGNAL) < (int)sizeof(total))
     cerr << "write total=" << total << " failed!" << endl;
   else cerr << "wrote total=" << total << endl;
-  if(send(master_sock, (char*)&node, sizeof(node), 0) < (int)sizeof(node))
+  if(send(master_sock, (char*)&node, sizeof(node), MSG_NOSIGNAL) < (int)sizeof(node))
     cerr << "write node=" << node << " failed!" << endl;
   else cerr << "wrote node=" << node << endl;
   int ok;
   if (recv(master_sock, (char*)&ok, sizeof(ok), 0) < (int)sizeof(ok))
-    cerr << "read ok failed!" << endl;
-  else cerr << "read ok=" << ok << endl;
+    THROW("read ok from " << span_server << " failed");
+  cerr << "read ok=" << ok << endl;
   if (!ok)
     THROW("mapper already connected");
 
@@ -137,9 +163,10 @@ void AllReduceSockets::all_reduce_init()
   uint16_t parent_port;
   uint32_t parent_ip;
 
+  // the span server closes the connection if it gives up waiting for the other nodes
   if(recv(master_sock, (char*)&kid_count, sizeof(kid_count), 0) < (int)sizeof(kid_count))
-    cerr << "read kid_count failed!" << endl;
-  else cerr << "read kid_count=" << kid_count << endl;
+    THROW("read kid_count failed, " << span_server << " gave up on the other nodes");
+  cerr << "read kid_count=" << kid_count << endl;
 
   socket_t sock = -1;
   short unsigned int netport = htons(26544);
@@ -178,12 +205,11 @@ void AllReduceSockets::all_reduce_init()
     }
   }
 
-  if(send(master_sock, (const char*)&netport, sizeof(netport), 0) < (int)sizeof(netport))
+  if(send(master_sock, (const char*)&netport, sizeof(netport), MSG_NOSIGNAL) < (int)sizeof(netport))
     cerr << "write netport failed!" << endl;
 
   if(recv(master_sock, (char*)&parent_ip, sizeof(parent_ip), 0) < (int)sizeof(parent_ip))
-    cerr << "read parent_ip failed!" << endl;
-  else
+    THROW("read parent_ip failed");
   { char dotted_quad[INET_ADDRSTRLEN];
     if (nullptr == inet_ntop(AF_INET, (char*)&parent_ip, dotted_quad, INET_ADDRSTRLEN))
     { cerr << "read parent_ip=" << parent_ip << "(inet_ntop: " << strerror(errno) << ")" << endl;
@@ -192,13 +218,14 @@ void AllReduceSockets::all_reduce_init()
       cerr << "read parent_ip=" << dotted_quad << endl;
   }
   if(recv(master_sock, (char*)&parent_port, sizeof(parent_port), 0) < (int)sizeof(parent_port))
-    cerr << "read parent_port failed!" << endl;
-  else cerr << "read parent_port=" << parent_port << endl;
+    THROW("read parent_port failed");
+  cerr << "read parent_port=" << parent_port << endl;
 
   CLOSESOCK(master_sock);
 
   if(parent_ip != (uint32_t)-1)
   { socks.parent = sock_connect(parent_ip, parent_port);
+    set_timeout(socks.parent);
   }
   else
     socks.parent = -1;
@@ -216,6 +243,7 @@ void AllReduceSockets::all_reduce_init()
     // getnameinfo((sockaddr *) &child_address, sizeof(sockaddr), hostname, NI_MAXHOST, servInfo, NI_MAXSERV, NI_NUMERICSERV);
     // cerr << "connected to " << hostname << ':' << ntohs(port) << endl;
     socks.children[i] = f;
+    set_timeout(f);
   }
 
   if (kid_count > 0)
@@ -223,6 +251,29 @@ void AllReduceSockets::all_reduce_init()
 }
 
 
+void AllReduceSockets::set_timeout(socket_t sock)
+{ if (timeout == 0)
+    return;
+  // a node that is stopped or too slow makes recv and send fail instead of blocking forever
+#ifdef _WIN32
+  DWORD wait = (DWORD)timeout * 1000;
+#else
+  timeval wait = { (long)timeout, 0 };
+#endif
+  if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&wait, sizeof(wait)) < 0
+      || setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char*)&wait, sizeof(wait)) < 0)
+    THROWERRNO("setsockopt SO_RCVTIMEO/SO_SNDTIMEO");
+}
+
+bool AllReduceSockets::timed_out()
+{
+#ifdef _WIN32
+  return timeout > 0 && WSAGetLastError() == WSAETIMEDOUT;
+#else
+  return timeout > 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+}
+
 void AllReduceSockets::pass_down(char* buffer, const size_t parent_read_pos, size_t& children_sent_pos)
 {
 
@@ -230,10 +281,12 @@ void AllReduceSockets::pass_down(char* buffer, const size_t parent_read_pos, siz
 
   if(my_bufsize > 0)
   { //going to pass up this chunk of data to the children
-    if(socks.children[0] != -1 && send(socks.children[0], buffer+children_sent_pos, (int)my_bufsize, 0) < (int)my_bufsize)
-      cerr<<"Write to left child failed\n";
-    if(socks.children[1] != -1 && send(socks.children[1], buffer+children_sent_pos, (int)my_bufsize, 0) < (int)my_bufsize)
-      cerr<<"Write to right child failed\n";
+    for (int i = 0; i < 2; i++)
+      if(socks.children[i] != -1 && send(socks.children[i], buffer+children_sent_pos, (int)my_bufsize, MSG_NOSIGNAL) < (int)my_bufsize)
+      { if (timed_out())
+          THROW("the " << (i == 0 ? "left" : "right") << " child took no data for " << timeout << " seconds, it is stopped or too slow");
+        THROWERRNO("Write to " << (i == 0 ? "left" : "right") << " child failed");
+      }
 
     children_sent_pos += my_bufsize;
   }
@@ -264,9 +317,12 @@ void AllReduceSockets::broadcast(char* buffer, const size_t n)
 
       size_t count = min(ar_buf_size,n-parent_read_pos);
       int read_size = recv(socks.parent, buffer + parent_read_pos, (int)count, 0);
+      if(read_size == -1 && timed_out())
+        THROW("the parent sent no data for " << timeout << " seconds, it is stopped or too slow");
       if(read_size == -1)
-      { cerr <<" recv from parent: " << strerror(errno) << endl;
-      }
+        THROWERRNO("recv from parent");
+      if(read_size == 0)
+        THROW("parent closed the connection");
       parent_read_pos += read_size;
     }
   }
@@ -8,52 +8,45 @@ This implements the allreduce function using threads.
 */
 #include "allreduce.h"
 #include <future>
+#include <thread>
 
 using namespace std;
 
-AllReduceSync::AllReduceSync(const size_t total) : m_total(total), m_count(0), m_run(true)
-{ m_mutex = new mutex;
-  m_cv = new condition_variable;
+AllReduceSync::AllReduceSync(const size_t total) : m_total(total)
+{ m_count = new atomic<size_t>(0);
+  m_sense = new atomic<bool>(false);
   buffers = new void*[total];
 }
 
 AllReduceSync::~AllReduceSync()
-{ delete m_mutex;
-  delete m_cv;
-  delete buffers;
+{ delete m_count;
+  delete m_sense;
+  delete[] buffers;
 }
 
-void AllReduceSync::waitForSynchronization()
-{ unique_lock<mutex> l(*m_mutex);
-  m_count++;
+void AllReduceSync::waitForSynchronization(bool& local_sense)
+{ local_sense = !local_sense;
 
-  if (m_count >= m_total)
-  { assert(m_count == m_total);
-
-    m_cv->notify_all();
-
-    // order of m_count before or after notify_all doesn't matter
-    // since the lock is still hold at this point in time.
-    m_count = 0;
-
-    // flip for the next run
-    m_run = !m_run;
+  if (m_count->fetch_add(1, memory_order_acq_rel) + 1 == m_total)
+  { // last one in: reset for the next run and release everybody
+    m_count->store(0, memory_order_relaxed);
+    m_sense->store(local_sense, memory_order_release);
   }
   else
-  { bool current_run = m_run;
-    // this predicate cannot depend on m_count, as somebody can race ahead and m_count++
-    // FYI just wait can spuriously wake-up
-    m_cv->wait(l, [this, current_run] { return m_run != current_run; });
+  { // spin briefly, then yield so oversubscribed hosts still make progress
+    for (size_t spins = 0; m_sense->load(memory_order_acquire) != local_sense; spins++)
+      if (spins >= 1024)
+        this_thread::yield();
   }
 }
 
 AllReduceThreads::AllReduceThreads(AllReduceThreads* root, const size_t ptotal, const size_t pnode)
-  : AllReduce(ptotal, pnode), m_sync(root->m_sync), m_syncOwner(false)
+  : AllReduce(ptotal, pnode), m_sync(root->m_sync), m_syncOwner(false), m_sense(false)
 {
 }
 
 AllReduceThreads::AllReduceThreads(const size_t ptotal, const size_t pnode)
-  : AllReduce(ptotal, pnode), m_sync(new AllReduceSync(ptotal)), m_syncOwner(true)
+  : AllReduce(ptotal, pnode), m_sync(new AllReduceSync(ptotal)), m_syncOwner(true), m_sense(false)
 {
 }
 
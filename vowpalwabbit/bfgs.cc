@@ -980,5 +980,6 @@ base_learner* bfgs_setup(vw& all)
   l.set_end_pass(end_pass);
   l.set_finish(finish);
 
-  return make_base(l);
+  all.linear_learner = make_base(l);
+  return all.linear_learner;
 }
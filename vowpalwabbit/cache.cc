@@ -12,25 +12,6 @@ const size_t char_size = 2;
 const size_t neg_1 = 1;
 const size_t general = 2;
 
-inline char* run_len_decode(char *p, uint64_t& i)
-{ // read an int 7 bits at a time.
-  size_t count = 0;
-  while(*p & 128)
-    i = i | ((uint64_t)(*(p++) & 127) << 7*count++);
-  i = i | ((uint64_t)(*(p++)) << 7*count);
-  return p;
-}
-
-inline char* run_len_encode(char *p, uint64_t i)
-{ // store an int 7 bits at a time.
-  while (i >= 128)
-  { *(p++) = (i & 127) | 128;
-    i = i >> 7;
-  }
-  *(p++) = (i & 127);
-  return p;
-}
-
 inline int64_t ZigZagDecode(uint64_t n) { return (n >> 1) ^ -static_cast<int64_t>(n & 1); }
 
 size_t read_cached_tag(io_buf& cache, example* ae)
@@ -115,7 +96,7 @@ int read_cached_features(void* in, example* ec)
           ae->sorted = false;
         i = last + s_diff;
         last = i;
-        ours.push_back(v,i);
+        ours.push_back(v, i & all->parse_mask); // a cache made with more bits, or unmasked indices from daemon_client
       }
     all->p->input->set(c);
   }
@@ -8,8 +8,24 @@ license as described in the file LICENSE.
 #include "io_buf.h"
 #include "example.h"
 
-char* run_len_decode(char *p, size_t& i);
-char* run_len_encode(char *p, size_t i);
+inline char* run_len_decode(char *p, uint64_t& i)
+{ // read an int 7 bits at a time.
+  size_t count = 0;
+  while(*p & 128)
+    i = i | ((uint64_t)(*(p++) & 127) << 7*count++);
+  i = i | ((uint64_t)(*(p++)) << 7*count);
+  return p;
+}
+
+inline char* run_len_encode(char *p, uint64_t i)
+{ // store an int 7 bits at a time.
+  while (i >= 128)
+  { *(p++) = (i & 127) | 128;
+    i = i >> 7;
+  }
+  *(p++) = (i & 127);
+  return p;
+}
 
 int read_cached_features(void*a, example* ec);
 void cache_tag(io_buf& cache, v_array<char> tag);
@@ -525,6 +525,42 @@ void predict_or_learn(cb_adf& data, base_learner& base, example &ec)
     data.ec_seq.push_back(&ec);
   }
 }
+
+// Predicts the set under count models, as predict_or_learn<false> does under one: every example of
+// the set is passed the same count and step.  pred[c].multiclass is the action model c ranks first.
+void multipredict(cb_adf& data, base_learner& base, example& ec, size_t count, size_t, polyprediction* pred, bool finalize_predictions)
+{ vw* all = data.all;
+  data.base = &base;
+  bool is_test_ec = CB::example_is_test(ec);
+  bool need_to_break = VW::is_ring_example(*all, &ec) && (data.ec_seq.size() >= all->p->ring_size - 2);
+
+  if ((example_is_newline_not_header(ec) && is_test_ec) || need_to_break)
+  { data.ec_seq.push_back(&ec);
+    test_adf_sequence(data);
+    data.known_cost = get_observed_cost(data.ec_seq);
+    gen_cs_example_ips(data.ec_seq, data.cs_labels);
+
+    data.cb_labels.erase();
+    size_t index = 0;
+    for (example* ecc : data.ec_seq)
+    { data.cb_labels.push_back(ecc->l.cb);
+      ecc->l.cs = data.cs_labels[index++];
+    }
+    for (example* ecc : data.ec_seq)
+      base.multipredict(*ecc, 0, count, pred, finalize_predictions);
+    index = 0;
+    for (example* ecc : data.ec_seq)
+      ecc->l.cb = data.cb_labels[index++];
+    data.need_to_clear = true;
+  }
+  else
+  { if (data.need_to_clear)
+    { data.ec_seq.erase();
+      data.need_to_clear = false;
+    }
+    data.ec_seq.push_back(&ec);
+  }
+}
 }
 
 base_learner* cb_adf_setup(vw& all)
@@ -600,6 +636,7 @@ base_learner* cb_adf_setup(vw& all)
 
   learner<cb_adf>& l = init_learner(&ld, base, CB_ADF::predict_or_learn<true>, CB_ADF::predict_or_learn<false>, problem_multiplier);
   l.set_finish_example(CB_ADF::finish_multiline_example);
+  l.set_multipredict(CB_ADF::multipredict);
 
   l.increment = base->increment;
   ld.scorer = all.scorer;
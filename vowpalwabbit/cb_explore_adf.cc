@@ -40,6 +40,8 @@ namespace CB_EXPLORE_ADF{
 
     v_array<example*> ec_seq;
     v_array<action_score> id_probs;
+    v_array<uint32_t> position; // bagging: index of each action in id_probs
+    v_array<polyprediction> member_preds; // bagging: first action of every member but the first
 
     size_t explore_type;
 
@@ -65,6 +67,21 @@ namespace CB_EXPLORE_ADF{
     ele1 = temp;
   }
 
+  // The exploration distributions are built in id_probs, a copy of the base's ranking, because
+  // learning overwrites the ranking.  The copy and the final copy back are single block moves.
+  inline void start_distribution(cb_explore_adf& data, v_array<action_score>& preds, float score)
+  {
+    copy_array(data.id_probs, preds);
+    for (action_score& a_s : data.id_probs)
+      a_s.score = score;
+  }
+
+  inline void return_distribution(cb_explore_adf& data, v_array<example*>& examples, size_t num_actions)
+  {
+    if (data.id_probs.size() == num_actions)
+      memcpy(examples[0]->pred.a_s.begin(), data.id_probs.begin(), num_actions * sizeof(action_score));
+  }
+
   template <bool is_learn>
   void predict_or_learn_first(cb_explore_adf& data, base_learner& base, v_array<example*>& examples, bool isTest, bool shared)
   { //Explore tau times, then act according to optimal.
@@ -80,22 +97,11 @@ namespace CB_EXPLORE_ADF{
 
     if (!is_learn || !data.learn_only) {
       if (data.tau) {
-        float prob = 1.0 / (float)num_actions;
-        for (size_t i = 0; i < num_actions; i++) {
-          action_score a_s;
-          a_s.action = preds[i].action;
-          a_s.score = prob;
-          data.id_probs.push_back(a_s);
-        }
+        start_distribution(data, preds, 1.f / (float)num_actions);
         data.tau--;
       }
       else {
-        for (size_t i = 0; i < num_actions; i++) {
-          action_score a_s;
-          a_s.action = preds[i].action;
-          a_s.score = 0.;
-          data.id_probs.push_back(a_s);
-        }
+        start_distribution(data, preds, 0.f);
         data.id_probs[0].score = 1.0;
       }
     }
@@ -104,11 +110,7 @@ namespace CB_EXPLORE_ADF{
       for (example* ec : examples)
         base.learn(*ec);
 
-    for (size_t i = 0; i < num_actions; i++) {
-      examples[0]->pred.a_s[i].score = data.id_probs[i].score;
-      examples[0]->pred.a_s[i].action = data.id_probs[i].action;
-    }
-
+    return_distribution(data, examples, num_actions);
   }
 
   template <bool is_learn>
@@ -125,26 +127,23 @@ namespace CB_EXPLORE_ADF{
       THROW("Received predictions of wrong size from CB base learner");
 
     if(!is_learn || !data.learn_only) {
-      float prob = data.epsilon/(float)num_actions;
-      for(size_t i = 0;i < num_actions;i++) {
-	action_score a_s;
-	a_s.action = preds[i].action;
-	a_s.score = prob;
-	data.id_probs.push_back(a_s);
-      }
+      start_distribution(data, preds, data.epsilon/(float)num_actions);
       data.id_probs[0].score += (1 - data.epsilon);
     }
 
-
     if (is_learn)
       for (example* ec : examples)
         base.learn(*ec);
 
-    for (size_t i = 0; i < num_actions; i++) {
-      examples[0]->pred.a_s[i].score = data.id_probs[i].score;
-      examples[0]->pred.a_s[i].action = data.id_probs[i].action;
-    }
+    return_distribution(data, examples, num_actions);
+  }
 
+  // Moves the whole set to another bag member's weights.  base.learn(ec, i) would move only the
+  // example passed, but the set is learned from when its last example arrives.
+  void shift_examples(v_array<example*>& examples, uint64_t offset)
+  {
+    for (example* ec : examples)
+      ec->ft_offset += offset;
   }
 
   template <bool is_learn>
@@ -161,21 +160,24 @@ namespace CB_EXPLORE_ADF{
       THROW("Received predictions of wrong size from CB base learner");
 
     if (!is_learn || !data.learn_only) {
-      for (size_t i = 0; i < num_actions; i++) {
-        action_score a_s;
-        a_s.action = preds[i].action;
-        a_s.score = 0.;
-        data.id_probs.push_back(a_s);
-      }
+      start_distribution(data, preds, 0.f);
+      // where each action sits in id_probs, so that a bag member's vote is one lookup
+      data.position.resize(num_actions);
+      data.position.end() = data.position.end_array;
+      for (size_t i = 0; i < num_actions; i++)
+        data.position[data.id_probs[i].action] = (uint32_t)i;
+
       float prob = 1.0 / (float)data.bag_size;
       data.id_probs[0].score += prob;
-      for (size_t i = 1; i < data.bag_size; i++) {
+      if (data.bag_size > 1) {
+        // the other members in one pass over the set, each ranks its first action
+        data.member_preds.resize(data.bag_size - 1);
+        shift_examples(examples, base.increment);
         for (example* ec : examples)
-          base.predict(*ec, i);
-        uint32_t chosen = preds[0].action;
-        for (size_t i = 0; i < num_actions; i++)
-          if (data.id_probs[i].action == chosen)
-            data.id_probs[i].score += prob;
+          base.multipredict(*ec, 0, data.bag_size - 1, data.member_preds.begin(), true);
+        shift_examples(examples, -(uint64_t)base.increment);
+        for (size_t i = 0; i < data.bag_size - 1; i++)
+          data.id_probs[data.position[data.member_preds[i].multiclass]].score += prob;
       }
     }
 
@@ -183,16 +185,14 @@ namespace CB_EXPLORE_ADF{
       for (size_t i = 0; i < data.bag_size; i++)
       {
         uint32_t count = BS::weight_gen();
+        shift_examples(examples, i * base.increment);
         for (uint32_t j = 0; j < count; j++)
           for (example* ec : examples)
-            base.learn(*ec, i);
+            base.learn(*ec);
+        shift_examples(examples, -(uint64_t)(i * base.increment));
       }
 
-    for (size_t i = 0; i < num_actions; i++) {
-      examples[0]->pred.a_s[i].score = data.id_probs[i].score;
-      examples[0]->pred.a_s[i].action = data.id_probs[i].action;
-    }
-
+    return_distribution(data, examples, num_actions);
   }
 
 
@@ -207,32 +207,26 @@ namespace CB_EXPLORE_ADF{
       num_actions--;
     if (preds.size() != num_actions)
       THROW("Received predictions of wrong size from CB base learner");
-    float norm = 0.;
-    float max_score = preds[0].score;
 
     if (!is_learn || !data.learn_only) {
-      for (size_t i = 0; i < num_actions; i++) {
-        float prob = exp(data.lambda*(preds[i].score - max_score));
-        action_score a_s;
-        a_s.action = preds[i].action;
-        a_s.score = prob;
-        data.id_probs.push_back(a_s);
-        norm += prob;
+      copy_array(data.id_probs, preds);
+      float max_score = preds[0].score;
+      float norm = 0.;
+      for (action_score& a_s : data.id_probs) {
+        a_s.score = exp(data.lambda*(a_s.score - max_score));
+        norm += a_s.score;
       }
-      for (size_t i = 0; i < num_actions; i++)
-        data.id_probs[i].score /= norm;
+      float inv_norm = 1.f / norm;
+      for (action_score& a_s : data.id_probs)
+        a_s.score *= inv_norm;
     }
 
-
     if (is_learn) {
       for (example* ec : examples)
         base.learn(*ec);
     }
 
-    for (size_t i = 0; i < num_actions; i++) {
-      examples[0]->pred.a_s[i].score = data.id_probs[i].score;
-      examples[0]->pred.a_s[i].action = data.id_probs[i].action;
-    }
+    return_distribution(data, examples, num_actions);
   }
 
   void end_examples(cb_explore_adf& data)
@@ -247,6 +241,8 @@ namespace CB_EXPLORE_ADF{
   {
     data.ec_seq.delete_v();
     data.id_probs.delete_v();
+    data.position.delete_v();
+    data.member_preds.delete_v();
   }
 
 
@@ -450,6 +446,8 @@ base_learner* cb_explore_adf_setup(vw& all)
   po::variables_map& vm = all.vm;
   cb_explore_adf& data = calloc_or_throw<cb_explore_adf>();
   data.id_probs = v_init<action_score>();
+  data.position = v_init<uint32_t>();
+  data.member_preds = v_init<polyprediction>();
 
   data.all = &all;
   if (count(all.args.begin(), all.args.end(), "--cb_adf") == 0)
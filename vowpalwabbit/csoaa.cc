@@ -127,6 +127,17 @@ base_learner* csoaa_setup(vw& all)
 using namespace ACTION_SCORE;
 
 // TODO: passthrough for ldf
+// How the shared example of a set meets one action.  Shared namespaces that are in the action, or
+// that reach it through the interactions, are appended to the action as before.  Everything else of
+// the shared example is the same for every action with the same namespaces and ft_offset, and is
+// computed once per set.
+struct shared_split
+{ uint64_t ft_offset;
+  bool action_space[256]; // namespaces of the actions this split is for
+  bool visible[256]; // shared namespaces appended to those actions
+  float score; // linear terms of the shared namespaces not in the action, interactions of the rest
+};
+
 struct ldf
 { v_array<example*> ec_seq;
   LabelDict::label_feature_map label_features;
@@ -146,6 +157,11 @@ struct ldf
 
   v_array<action_scores > stored_preds;
   base_learner* base;
+
+  bool linear_base; // base is a plain linear learner: actions are scored by score_actions
+  v_array<shared_split> shared_splits; // for the current set
+  v_array<polyprediction> member_scores; // multipredict: one action's score under each model
+  v_array<float> member_best; // multipredict: lowest score of each model so far
 };
 
 int cmp(size_t a, size_t b)
@@ -246,6 +262,168 @@ void make_single_prediction(ldf& data, base_learner& base, example& ec)
   ec.l.cs = ld;
 }
 
+shared_split& find_shared_split(ldf& data, example& shared, example& ec)
+{ bool action_space[256] = {};
+  for (namespace_index ns : ec.indices)
+    action_space[ns] = true;
+  for (shared_split& split : data.shared_splits)
+    if (split.ft_offset == ec.ft_offset && !memcmp(split.action_space, action_space, sizeof(action_space)))
+      return split;
+
+  vw& all = *data.all;
+  shared_split split;
+  split.ft_offset = ec.ft_offset;
+  memcpy(split.action_space, action_space, sizeof(action_space));
+
+  // Namespaces reached from the action through interactions, closed so that every interaction lies
+  // either entirely outside of them or has all of its shared namespaces inside.
+  bool reached[256];
+  memcpy(reached, action_space, sizeof(reached));
+  for (bool grown = true; grown;)
+  { grown = false;
+    for (v_string& inter : all.interactions)
+    { bool touches = false;
+      for (unsigned char ns : inter)
+        touches |= reached[ns];
+      if (touches)
+        for (unsigned char ns : inter)
+          if (!reached[ns])
+            reached[ns] = grown = true;
+    }
+  }
+
+  // Linear terms of shared namespaces the action does not have: those still interact through
+  // ec.feature_space when visible, but gd only sums the namespaces listed in ec.indices.
+  split.score = 0.;
+  memset(split.visible, 0, sizeof(split.visible));
+  features hidden[256];
+  for (namespace_index ns : shared.indices)
+  { if (ns == constant_namespace)
+      continue;
+    split.visible[ns] = reached[ns];
+    if (!action_space[ns])
+      GD::foreach_feature<float, GD::vec_add>(all.reg.weight_vector, all.reg.weight_mask, shared.feature_space[ns], split.score, ec.ft_offset);
+  }
+
+  // Interactions among the remaining shared namespaces, with the reached ones and the constant hidden.
+  for (namespace_index ns : shared.indices)
+    if (ns == constant_namespace || reached[ns])
+      swap(hidden[ns], shared.feature_space[ns]);
+  uint64_t ft_offset = shared.ft_offset;
+  shared.ft_offset = ec.ft_offset;
+  INTERACTIONS::generate_interactions<float, float&, GD::vec_add>(all, shared, split.score);
+  shared.ft_offset = ft_offset;
+  for (namespace_index ns : shared.indices)
+    if (ns == constant_namespace || reached[ns])
+      swap(hidden[ns], shared.feature_space[ns]);
+
+  data.shared_splits.push_back(split);
+  return *(data.shared_splits.end() - 1);
+}
+
+// Appends what an action sees of the shared example, followed by its label features as
+// make_single_prediction would.  Returns the action's split of the shared example, if any.
+shared_split* attach_shared(ldf& data, example* shared, example& ec)
+{ size_t lab = ec.l.cs.costs[0].class_index;
+  LabelDict::add_example_namespace_from_memory(data.label_features, ec, lab);
+  if (shared == nullptr)
+    return nullptr;
+
+  shared_split& split = find_shared_split(data, *shared, ec);
+  LabelDict::del_example_namespace_from_memory(data.label_features, ec, lab);
+  for (namespace_index ns : shared->indices)
+    if (split.visible[ns])
+    { features& fs = shared->feature_space[ns];
+      features& target = ec.feature_space[ns];
+      for (size_t i = 0; i < fs.size(); ++i)
+        target.push_back(fs.values[i], fs.indicies[i]);
+    }
+  LabelDict::add_example_namespace_from_memory(data.label_features, ec, lab);
+  return &split;
+}
+
+void detach_shared(ldf& data, example* shared, shared_split* split, example& ec)
+{ LabelDict::del_example_namespace_from_memory(data.label_features, ec, ec.l.cs.costs[0].class_index);
+  if (shared == nullptr)
+    return;
+
+  for (namespace_index ns : shared->indices)
+    if (split->visible[ns])
+    { features& fs = shared->feature_space[ns];
+      features& target = ec.feature_space[ns];
+      target.truncate_to(target.size() - fs.size());
+      target.sum_feat_sq -= fs.sum_feat_sq;
+    }
+}
+
+const size_t score_block = 16; // actions whose weight loads are in flight together
+
+// With a linear base the actions of a set are scored straight from the weights, a block at a time:
+// the linear weights of every action of the block are prefetched before any of them is summed.
+// Interactions are not prefetched, generating their hashes twice costs more than the misses it
+// hides.  This gives the partial_prediction base.predict would.
+void score_actions(ldf& data, size_t start_K)
+{ vw& all = *data.all;
+  example* shared = start_K > 0 ? data.ec_seq[0] : nullptr;
+  GD::prefetch_info prefetch = { all.reg.weight_vector, all.reg.weight_mask };
+  // At most one split per action, reserved up front so that pointers into them stay valid.
+  if ((size_t)(data.shared_splits.end_array - data.shared_splits.begin()) < data.ec_seq.size())
+    data.shared_splits.resize(data.ec_seq.size());
+  shared_split* splits[score_block];
+
+  for (size_t begin = start_K; begin < data.ec_seq.size(); begin += score_block)
+  { size_t end = min(begin + score_block, data.ec_seq.size());
+    for (size_t k = begin; k < end; k++)
+      splits[k - begin] = attach_shared(data, shared, *data.ec_seq[k]);
+    for (size_t k = begin; k < end; k++)
+      for (features& fs : *data.ec_seq[k])
+        GD::foreach_feature<GD::prefetch_info, GD::prefetch_weight>(all.reg.weight_vector, all.reg.weight_mask, fs, prefetch, data.ec_seq[k]->ft_offset);
+
+    for (size_t k = begin; k < end; k++)
+    { example& ec = *data.ec_seq[k];
+      float score = splits[k - begin] == nullptr ? 0.f : splits[k - begin]->score;
+      GD::foreach_feature<float, GD::vec_add>(all, ec, score);
+      ec.partial_prediction = score * (float)all.sd->contraction;
+      ec.l.cs.costs[0].partial_prediction = ec.partial_prediction;
+    }
+
+    for (size_t k = begin; k < end; k++)
+      detach_shared(data, shared, splits[k - begin], *data.ec_seq[k]);
+  }
+}
+
+// score_actions for count models, step apart in the weights: every feature is read once and
+// summed into all count scores.  pred[c].multiclass is the action model c ranks first.
+void score_members(ldf& data, size_t start_K, size_t count, size_t step, polyprediction* pred)
+{ vw& all = *data.all;
+  example* shared = start_K > 0 ? data.ec_seq[0] : nullptr;
+  if ((size_t)(data.shared_splits.end_array - data.shared_splits.begin()) < data.ec_seq.size() * count)
+    data.shared_splits.resize(data.ec_seq.size() * count);
+  data.member_scores.resize(count);
+  data.member_best.resize(count);
+
+  for (size_t k = start_K; k < data.ec_seq.size(); k++)
+  { example& ec = *data.ec_seq[k];
+    shared_split* split = attach_shared(data, shared, ec);
+    for (size_t c = 0; c < count; c++)
+    { ec.ft_offset += c * step;
+      data.member_scores[c].scalar = split == nullptr ? 0.f : find_shared_split(data, *shared, ec).score;
+      ec.ft_offset -= c * step;
+    }
+
+    GD::multipredict_info mp = { count, step, data.member_scores.begin(), &all.reg, (float)all.sd->gravity };
+    GD::foreach_feature<GD::multipredict_info, uint64_t, GD::vec_add_multipredict>(all, ec, mp);
+    for (size_t c = 0; c < count; c++)
+    { float score = data.member_scores[c].scalar * (float)all.sd->contraction;
+      if (k == start_K || score < data.member_best[c]) // ties go to the first action, as in score_comp
+      { data.member_best[c] = score;
+        pred[c].multiclass = (uint32_t)(k - start_K);
+      }
+    }
+    detach_shared(data, shared, split, ec);
+  }
+}
+
 bool check_ldf_sequence(ldf& data, size_t start_K)
 { bool isTest = COST_SENSITIVE::example_is_test(*data.ec_seq[start_K]);
   for (size_t k=start_K; k<data.ec_seq.size(); k++)
@@ -393,15 +571,22 @@ void do_actual_learning(ldf& data, base_learner& base)
   /////////////////////// add headers
   size_t K = data.ec_seq.size();
   size_t start_K = 0;
+  bool merged = false;
 
   if (ec_is_example_header(*data.ec_seq[0]))
   { start_K = 1;
-    for (size_t k=1; k<K; k++)
-      LabelDict::add_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
+    if (!data.linear_base)
+    { for (size_t k=1; k<K; k++)
+        LabelDict::add_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
+      merged = true;
+    }
+    data.shared_splits.erase();
   }
   bool isTest = check_ldf_sequence(data, start_K);
 
   /////////////////////// do prediction
+  if (data.linear_base)
+    score_actions(data, start_K);
   size_t predicted_K = start_K;
   if(data.rank)
   { data.a_s.erase();
@@ -412,7 +597,8 @@ void do_actual_learning(ldf& data, base_learner& base)
     for (size_t k=start_K; k<K; k++)
     { data.stored_preds.push_back(data.ec_seq[k]->pred.a_s);
       example *ec = data.ec_seq[k];
-      make_single_prediction(data, base, *ec);
+      if (!data.linear_base)
+        make_single_prediction(data, base, *ec);
       action_score s;
       s.score = ec->partial_prediction;
       s.action = k - start_K;
@@ -425,7 +611,8 @@ void do_actual_learning(ldf& data, base_learner& base)
   { float  min_score = FLT_MAX;
     for (size_t k=start_K; k<K; k++)
     { example *ec = data.ec_seq[k];
-      make_single_prediction(data, base, *ec);
+      if (!data.linear_base)
+        make_single_prediction(data, base, *ec);
       if (ec->partial_prediction < min_score)
       { min_score = ec->partial_prediction;
         predicted_K = k;
@@ -435,7 +622,12 @@ void do_actual_learning(ldf& data, base_learner& base)
 
   /////////////////////// learn
   if (is_learn && !isTest)
-  { if (data.is_wap) do_actual_learning_wap(data, base, start_K);
+  { if (start_K > 0 && !merged)
+    { for (size_t k=1; k<K; k++)
+        LabelDict::add_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
+      merged = true;
+    }
+    if (data.is_wap) do_actual_learning_wap(data, base, start_K);
     else             do_actual_learning_oaa(data, base, start_K);
   }
 
@@ -458,9 +650,17 @@ void do_actual_learning(ldf& data, base_learner& base)
         data.ec_seq[k]->pred.multiclass =  0;
   }
   /////////////////////// remove header
-  if (start_K > 0)
+  if (merged)
     for (size_t k=1; k<K; k++)
       LabelDict::del_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
+  else if (start_K > 0) // report the shared features as part of every action, as merging does
+  { size_t shared_features = 0;
+    for (namespace_index ns : data.ec_seq[0]->indices)
+      if (ns != constant_namespace)
+        shared_features += data.ec_seq[0]->feature_space[ns].size();
+    for (size_t k=1; k<K; k++)
+      data.ec_seq[k]->num_features += shared_features;
+  }
 
   ////////////////////// compute probabilities
   if (data.is_probabilities)
@@ -697,6 +897,45 @@ void finish(ldf& data)
   LabelDict::free_label_features(data.label_features);
   data.a_s.delete_v();
   data.stored_preds.delete_v();
+  data.shared_splits.delete_v();
+  data.member_scores.delete_v();
+  data.member_best.delete_v();
+}
+
+void shift_sequence(ldf& data, uint64_t offset)
+{ for (example* ec : data.ec_seq)
+    ec->ft_offset += offset;
+}
+
+// The set is predicted once for each of count models, the examples of model c all moved c*step
+// further in the weights.  pred[c].multiclass is the action model c ranks first.
+void predict_members(ldf& data, base_learner& base, size_t count, size_t step, polyprediction* pred)
+{ if (data.ec_seq.size() == 0)
+    return;
+  if (!data.linear_base || ec_seq_is_label_definition(data.ec_seq))
+  { for (size_t c = 0; c < count; c++)
+    { shift_sequence(data, c * step);
+      do_actual_learning<false>(data, base);
+      shift_sequence(data, -(uint64_t)(c * step));
+      pred[c].multiclass = data.a_s.size() > 0 ? data.a_s[0].action : 0;
+    }
+    return;
+  }
+
+  size_t start_K = ec_is_example_header(*data.ec_seq[0]) ? 1 : 0;
+  data.shared_splits.erase();
+  check_ldf_sequence(data, start_K);
+  score_members(data, start_K, count, step, pred);
+
+  // count predictions would each have reported the shared features as part of every action
+  if (start_K > 0)
+  { size_t shared_features = 0;
+    for (namespace_index ns : data.ec_seq[0]->indices)
+      if (ns != constant_namespace)
+        shared_features += data.ec_seq[0]->feature_space[ns].size();
+    for (size_t k=1; k<data.ec_seq.size(); k++)
+      data.ec_seq[k]->num_features += shared_features * count;
+  }
 }
 
 template <bool is_learn>
@@ -735,6 +974,28 @@ void predict_or_learn(ldf& data, base_learner& base, example &ec)
   }
 }
 
+// Sequenced like predict_or_learn<false>, every example of a set is passed the same count and step
+// and the set is predicted by predict_members.  Label definitions are processed as usual.
+void multipredict(ldf& data, base_learner& base, example& ec, size_t count, size_t step, polyprediction* pred, bool)
+{ if (ec_is_label_definition(ec))
+  { predict_or_learn<false>(data, base, ec);
+    return;
+  }
+  bool need_to_break = data.ec_seq.size() >= data.all->p->ring_size - 2;
+
+  if ((example_is_newline(ec) && COST_SENSITIVE::example_is_test(ec)) || need_to_break)
+  { predict_members(data, base, count, step, pred);
+    data.need_to_clear = true;
+  }
+  else
+  { if (data.need_to_clear)
+    { data.ec_seq.erase();
+      data.need_to_clear = false;
+    }
+    data.ec_seq.push_back(&ec);
+  }
+}
+
 base_learner* csldf_setup(vw& all)
 { if (missing_option<string, true>(all, "csoaa_ldf", "Use one-against-all multiclass learning with label dependent features.  Specify singleline or multiline.")
       && missing_option<string, true>(all, "wap_ldf", "Use weighted all-pairs multiclass learning with label dependent features.  Specify singleline or multiline."))
@@ -742,7 +1003,8 @@ base_learner* csldf_setup(vw& all)
   new_options(all, "LDF Options")
   ("ldf_override", po::value<string>(), "Override singleline or multiline from csoaa_ldf or wap_ldf, eg if stored in file")
   ("csoaa_rank", "Return actions sorted by score order")
-  ("probabilities", "predict probabilites of all classes");
+  ("probabilities", "predict probabilites of all classes")
+  ("ldf_base_predict", "Score actions with the base learner even when it is linear, instead of straight from the weights");
   add_options(all);
 
   po::variables_map& vm = all.vm;
@@ -819,7 +1081,13 @@ base_learner* csldf_setup(vw& all)
 
   ld.read_example_this_loop = 0;
   ld.need_to_clear = false;
-  learner<ldf>& l = init_learner(&ld, setup_base(all), predict_or_learn<true>, predict_or_learn<false>);
+  base_learner* base = setup_base(all);
+  // score_actions and the shared split rely on the base summing weights over ec.indices and
+  // interactions over ec.feature_space on top of the initial prediction, as gd, ftrl and bfgs do.
+  ld.linear_base = !vm.count("ldf_base_predict") && base == all.scorer && all.linear_scorer && all.reg_mode % 2 == 0 && !all.audit && !all.hash_inv;
+  learner<ldf>& l = init_learner(&ld, base, predict_or_learn<true>, predict_or_learn<false>);
+  if (ld.rank && !ld.is_singleline)
+    l.set_multipredict(multipredict);
   if (ld.is_singleline)
     l.set_finish_example(finish_singleline_example);
   else
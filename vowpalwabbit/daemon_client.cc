@@ -0,0 +1,108 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#ifdef _WIN32
+#include <WinSock2.h>
+#ifndef SHUT_WR
+#   define SHUT_WR SD_SEND
+#endif
+#else
+#include <sys/socket.h>
+#endif
+#include <float.h>
+#include "daemon_client.h"
+#include "cache.h"
+#include "network.h"
+#include "global_data.h"
+#include "parse_primitives.h"
+
+using namespace std;
+
+namespace VW
+{
+daemon_client::daemon_client(const string& host)
+  : sent(0), received(0), closed(false)
+{ sd = open_socket(host.c_str());
+  buf.files.push_back(sd);
+  tag = v_init<char>();
+  indices = v_init<unsigned char>();
+  simple_label.default_label(&ld);
+}
+
+daemon_client::~daemon_client()
+{ close();
+  io_buf::close_file_or_socket(sd);
+  buf.files.erase();
+  tag.delete_v();
+  indices.delete_v();
+  for (features& fs : spaces)
+    fs.delete_v();
+}
+
+uint64_t daemon_client::hash_space(const string& name)
+{ substring ss = { const_cast<char*>(name.c_str()), const_cast<char*>(name.c_str()) + name.size() };
+  return hashstring(ss, hash_base);
+}
+
+uint64_t daemon_client::hash_feature(const string& name, uint64_t space_hash)
+{ substring ss = { const_cast<char*>(name.c_str()), const_cast<char*>(name.c_str()) + name.size() };
+  return hashstring(ss, space_hash);
+}
+
+void daemon_client::add_feature(unsigned char ns, uint64_t index, float value)
+{ features& fs = spaces[ns];
+  if (fs.values.empty())
+    indices.push_back(ns);
+  fs.push_back(value, index);
+}
+
+void daemon_client::set_label(float label, float weight, float initial)
+{ ld.label = label;
+  ld.weight = weight;
+  ld.initial = initial;
+}
+
+void daemon_client::set_tag(const string& t)
+{ tag.erase();
+  push_many(tag, t.c_str(), t.size());
+}
+
+void daemon_client::send_example()
+{ simple_label.cache_label(&ld, buf);
+  cache_tag(buf, tag);
+  output_byte(buf, (unsigned char)indices.size());
+  for (unsigned char ns : indices)
+  { features& fs = spaces[ns];
+    fs.sort((uint64_t)-1); // sorted indices delta-encode compactly
+    output_features(buf, ns, fs, (uint64_t)-1);
+    fs.erase();
+  }
+  indices.erase();
+  tag.erase();
+  simple_label.default_label(&ld);
+  sent++;
+}
+
+void daemon_client::flush()
+{ if (buf.head != buf.space.begin())
+    buf.flush();
+}
+
+void daemon_client::receive_prediction(float& prediction, float& raw_prediction)
+{ if (received == sent)
+    THROW("daemon_client: no outstanding example");
+  flush();
+  get_prediction(sd, prediction, raw_prediction);
+  received++;
+}
+
+void daemon_client::close()
+{ if (closed)
+    return;
+  flush();
+  shutdown(sd, SHUT_WR);
+  closed = true;
+}
+}
@@ -0,0 +1,56 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+// A client for the binary protocol of --daemon.  Examples are sent pre-hashed in the cache
+// encoding (see cache.cc), so the daemon neither tokenizes nor hashes them.  Indices are sent as
+// hashed, the daemon masks them to its own -b.  Each result is a pair of floats: the final
+// prediction and the raw (pre-link) prediction.
+#include <string>
+#include "io_buf.h"
+#include "example.h"
+#include "simple_label.h"
+
+namespace VW
+{
+class daemon_client
+{
+public:
+  // host is "name[:port]".
+  daemon_client(const std::string& host);
+  ~daemon_client();
+
+  // Hashing identical to the text parser with the default --hash strings.
+  uint64_t hash_space(const std::string& name);
+  uint64_t hash_feature(const std::string& name, uint64_t space_hash);
+
+  void add_feature(unsigned char ns, uint64_t index, float value = 1.f);
+  void set_label(float label, float weight = 1.f, float initial = 0.f);
+  void set_tag(const std::string& tag);
+
+  // Encode the current example into the send buffer and start a new one.  Nothing is written to
+  // the socket until flush() or until the buffer fills up.
+  void send_example();
+  void flush();
+
+  // Blocks until the result for the oldest outstanding example arrives.
+  void receive_prediction(float& prediction, float& raw_prediction);
+  size_t outstanding() const { return sent - received; }
+
+  // Signals the end of the stream; outstanding results can still be received.
+  void close();
+
+private:
+  int sd;
+  io_buf buf;
+  label_data ld;
+  v_array<char> tag;
+  v_array<unsigned char> indices;
+  features spaces[256];
+  size_t sent;
+  size_t received;
+  bool closed;
+};
+}
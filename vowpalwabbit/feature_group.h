@@ -298,6 +298,27 @@ struct features {
     sum_feat_sq += v*v;
   }
 
+  // Appends a copy of each of the first n features, its value multiplied by scale and its index
+  // shifted by offset: what lrq and lrqfa add for one latent factor of one feature.
+  void push_back_scaled(size_t n, feature_value scale, feature_index offset)
+  {
+    size_t size = values.size();
+    if ((size_t)(values.end_array - values.begin()) < size + n)
+    { values.resize(2 * (size + n));
+      indicies.resize(2 * (size + n));
+    }
+    feature_value* v = values.end();
+    feature_index* i = indicies.end();
+    for (size_t j = 0; j < n; ++j)
+    { v[j] = scale * values[j];
+      i[j] = indicies[j] + offset;
+    }
+    for (size_t j = 0; j < n; ++j)
+      sum_feat_sq += v[j] * v[j];
+    values.end() += n;
+    indicies.end() += n;
+  }
+
   bool sort(uint64_t parse_mask)
   {
     if (indicies.size() == 0)
@@ -267,5 +267,6 @@ base_learner* ftrl_setup(vw& all)
   l.set_multipredict(multipredict);
   l.set_save_load(save_load);
   l.set_end_pass(end_pass);
-  return make_base(l);
+  all.linear_learner = make_base(l);
+  return all.linear_learner;
 }
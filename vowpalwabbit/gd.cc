@@ -6,6 +6,9 @@ license as described in the file LICENSE.
 #include "crossplat_compat.h"
 
 #include <float.h>
+#include <zlib.h>
+#include <thread>
+#include <mutex>
 #ifdef _WIN32
 #include <WinSock2.h>
 #else
@@ -25,6 +28,7 @@ license as described in the file LICENSE.
 #include "reductions.h"
 #include "vw.h"
 #include "floatbits.h"
+#include "cache.h"
 
 #define VERSION_SAVE_RESUME_FIX "7.10.1"
 
@@ -577,6 +581,404 @@ void sync_weights(vw& all)
   all.sd->contraction = 1.;
 }
 
+// With --mapped_model the weights are stored densely at a file offset that is a multiple of
+// mapped_alignment (and so of any common page size).  Test-only runs, which use a stride of one,
+// then mmap them copy-on-write instead of reading them, and processes serving the same model share
+// the pages none of them writes.  With --save_resume the whole stride is kept, so such models are read rather than mapped.
+const uint64_t mapped_alignment = 1 << 16;
+const uint64_t mapped_chunk = 1 << 12; // weights per read or write when not mapping
+
+int64_t seek_file(int f, int64_t offset, int whence)
+{
+#ifdef _WIN32
+  return _lseeki64(f, offset, whence);
+#else
+  return lseek(f, (off_t)offset, whence);
+#endif
+}
+
+void save_load_mapped_weights(vw& all, io_buf& model_file, bool read, bool resume)
+{ uint64_t length = (uint64_t)1 << all.num_bits;
+  weight* weights = all.reg.weight_vector;
+  stringstream msg;
+
+  uint32_t stride_shift = resume ? all.reg.stride_shift : 0;
+  bin_text_read_write_fixed_validated(model_file, (char*)&stride_shift, sizeof(stride_shift),
+                                      "", read, msg, false);
+  if (stride_shift > 16)
+    THROW("Model content is corrupted, bad weight stride " << stride_shift);
+
+  uint32_t padding = 0;
+  if (!read)
+  { int64_t pos = seek_file(model_file.files[0], 0, SEEK_CUR);
+    if (pos >= 0) // otherwise the weights stay unaligned and are read instead of mapped
+    { uint64_t start = (uint64_t)pos + (model_file.head - model_file.space.begin()) + sizeof(padding);
+      padding = (uint32_t)((mapped_alignment - start % mapped_alignment) % mapped_alignment);
+    }
+  }
+  bin_text_read_write_fixed_validated(model_file, (char*)&padding, sizeof(padding),
+                                      "", read, msg, false);
+
+  char* p;
+  if (read)
+  { if (stride_shift == all.reg.stride_shift && !all.training && !all.vm.count("feature_mask"))
+    { int f = model_file.files[model_file.current];
+      int64_t pos = seek_file(f, 0, SEEK_CUR);
+      size_t bytes = (size_t)(length << stride_shift) * sizeof(weight);
+      if (pos >= 0)
+      { uint64_t offset = (uint64_t)pos - (model_file.space.end() - model_file.head) + padding;
+        if (map_regressor(all, f, offset, bytes))
+        { seek_file(f, offset + bytes, SEEK_SET);
+          model_file.head = model_file.space.end() = model_file.space.begin();
+          return;
+        }
+      }
+    }
+
+    if (buf_read(model_file, p, padding) < padding)
+      THROW("Model content is corrupted, unexpected end of file before the weights");
+    uint32_t copy = min(stride_shift, all.reg.stride_shift);
+    for (uint64_t i = 0; i < length; i += mapped_chunk)
+    { uint64_t n = min(mapped_chunk, length - i);
+      size_t bytes = (size_t)(n << stride_shift) * sizeof(weight);
+      if (buf_read(model_file, p, bytes) < bytes)
+        THROW("Model content is corrupted, expected " << length << " weights");
+      for (uint64_t j = 0; j < n; j++)
+        memcpy(weights + ((i + j) << all.reg.stride_shift), p + (j << stride_shift) * sizeof(weight),
+               sizeof(weight) << copy);
+    }
+  }
+  else
+  { buf_write(model_file, p, padding);
+    memset(p, 0, padding);
+    v_array<weight> chunk = v_init<weight>();
+    chunk.resize(mapped_chunk);
+    for (uint64_t i = 0; i < length; i += mapped_chunk)
+    { uint64_t n = min(mapped_chunk, length - i);
+      weight* w = weights + (i << stride_shift);
+      if (stride_shift != all.reg.stride_shift)
+      { for (uint64_t j = 0; j < n; j++)
+          chunk[j] = weights[(i + j) << all.reg.stride_shift];
+        w = chunk.begin();
+      }
+      bin_write_fixed(model_file, (char*)w, (uint32_t)((n << stride_shift) * sizeof(weight)));
+    }
+    chunk.delete_v();
+  }
+}
+
+// With --compact_model only nonzero weights are stored, as records of the run_len_encode'd gap since
+// the previous stored index followed by that index's floats, so the --save_resume state of a weight
+// stays next to it.  Records are grouped in blocks, each preceded by its raw and stored lengths; a
+// block is zlib-compressed when a level was given and that made it smaller.  An empty block ends
+// the weights.
+const size_t compact_block = 1 << 16; // raw bytes per block, before the record that overflows it
+
+void write_compact_block(io_buf& model_file, char* data, uint32_t len, int level, v_array<char>& packed)
+{ uint32_t stored = len;
+  if (level > 0)
+  { uLongf packed_len = compressBound(len);
+    packed.resize(packed_len);
+    if (compress2((Bytef*)packed.begin(), &packed_len, (Bytef*)data, len, level) == Z_OK && packed_len < len)
+    { stored = (uint32_t)packed_len;
+      data = packed.begin();
+    }
+  }
+  bin_write_fixed(model_file, (char*)&len, sizeof(len));
+  bin_write_fixed(model_file, (char*)&stored, sizeof(stored));
+  bin_write_fixed(model_file, data, stored);
+}
+
+void save_load_compact_weights(vw& all, io_buf& model_file, bool read, uint32_t floats)
+{ uint64_t length = (uint64_t)1 << all.num_bits;
+  uint32_t stride_shift = all.reg.stride_shift;
+  stringstream msg;
+
+  uint32_t stored_floats = floats; // per index in the file
+  bin_text_read_write_fixed_validated(model_file, (char*)&stored_floats, sizeof(stored_floats),
+                                      "", read, msg, false);
+  if (stored_floats == 0 || stored_floats > 16)
+    THROW("Model content is corrupted, bad number of floats per weight " << stored_floats);
+  size_t record = stored_floats * sizeof(weight);
+  size_t copy = min(min(stored_floats, floats), (uint32_t)1 << stride_shift) * sizeof(weight);
+
+  v_array<char> raw = v_init<char>();
+  v_array<char> packed = v_init<char>();
+  raw.resize(compact_block + 10 + record);
+  uint64_t next = 0; // index following the last stored one
+
+  if (read)
+  { while (true)
+    { uint32_t len = 0;
+      uint32_t stored = 0;
+      if (bin_read_fixed(model_file, (char*)&len, sizeof(len), "") < sizeof(len)
+          || bin_read_fixed(model_file, (char*)&stored, sizeof(stored), "") < sizeof(stored))
+        THROW("Model content is corrupted, unexpected end of file in the weights");
+      if (len == 0)
+        break;
+      if (len > raw.end_array - raw.begin() || stored > len)
+        THROW("Model content is corrupted, bad weight block length " << len);
+
+      char* p;
+      if (buf_read(model_file, p, stored) < stored)
+        THROW("Model content is corrupted, unexpected end of file in the weights");
+      if (stored < len)
+      { uLongf raw_len = len;
+        if (uncompress((Bytef*)raw.begin(), &raw_len, (Bytef*)p, stored) != Z_OK || raw_len != len)
+          THROW("Model content is corrupted, bad compressed weight block");
+        p = raw.begin();
+      }
+
+      char* end = p + len;
+      while (p < end)
+      { uint64_t gap = 0;
+        p = run_len_decode(p, gap);
+        uint64_t i = next + gap;
+        if (i >= length || p + record > end)
+          THROW("Model content is corrupted, weight vector index " << i << " must be less than total vector length " << length);
+        memcpy(&all.reg.weight_vector[i << stride_shift], p, copy);
+        p += record;
+        next = i + 1;
+      }
+    }
+  }
+  else
+  { char* p = raw.begin();
+    for (uint64_t i = 0; i < length; i++)
+    { weight* v = &all.reg.weight_vector[i << stride_shift];
+      if (*v == 0.)
+        continue;
+      p = run_len_encode(p, i - next);
+      memcpy(p, v, record);
+      p += record;
+      next = i + 1;
+      if ((size_t)(p - raw.begin()) >= compact_block)
+      { write_compact_block(model_file, raw.begin(), (uint32_t)(p - raw.begin()), all.compact_model_level, packed);
+        p = raw.begin();
+      }
+    }
+    if (p != raw.begin())
+      write_compact_block(model_file, raw.begin(), (uint32_t)(p - raw.begin()), all.compact_model_level, packed);
+    write_compact_block(model_file, raw.begin(), 0, 0, packed);
+  }
+
+  raw.delete_v();
+  packed.delete_v();
+}
+
+// With --chunked_model the weights are stored densely in chunks of chunked_block indices, each
+// preceded by a murmur checksum of its bytes seeded with the chunk number.  Since every chunk has a
+// fixed size and position, plain model files are written and read with pwrite/pread by one thread
+// per core, each checksumming its own chunks.  Compressed or unseekable files take the same layout
+// through the io_buf, one chunk after the other.
+const uint64_t chunked_block = 1 << 16;
+
+struct weight_chunks
+{ vw* all;
+  bool read;
+  uint32_t stride_shift; // of the stored weights
+  uint64_t chunks;
+  int file;
+  uint64_t offset; // of the first chunk in file
+  mutex lock;
+  string error;
+};
+
+size_t chunk_bytes(weight_chunks& wc, uint64_t k)
+{ uint64_t n = min(chunked_block, ((uint64_t)1 << wc.all->num_bits) - k * chunked_block);
+  return (size_t)(n << wc.stride_shift) * sizeof(weight);
+}
+
+// Copies chunk k between the weights and stored, which holds it as in the file.
+void copy_chunk(weight_chunks& wc, uint64_t k, char* stored)
+{ regressor& reg = wc.all->reg;
+  uint64_t first = k * chunked_block;
+  uint64_t n = chunk_bytes(wc, k) / (sizeof(weight) << wc.stride_shift);
+  size_t copy = sizeof(weight) << min(wc.stride_shift, reg.stride_shift);
+  for (uint64_t j = 0; j < n; j++)
+  { weight* w = reg.weight_vector + ((first + j) << reg.stride_shift);
+    char* s = stored + (j << wc.stride_shift) * sizeof(weight);
+    if (wc.read)
+      memcpy(w, s, copy);
+    else
+      memcpy(s, w, copy);
+  }
+}
+
+// Returns the buffer holding chunk k as stored: the weights themselves when the strides agree.
+char* chunk_data(weight_chunks& wc, uint64_t k, v_array<char>& buf)
+{ if (wc.stride_shift == wc.all->reg.stride_shift)
+    return (char*)(wc.all->reg.weight_vector + ((k * chunked_block) << wc.stride_shift));
+  buf.resize(chunk_bytes(wc, 0));
+  return buf.begin();
+}
+
+bool transfer_at(int f, char* data, size_t bytes, uint64_t offset, bool read)
+{
+#ifdef _WIN32
+  return false;
+#else
+  while (bytes > 0)
+  { ssize_t done = read ? pread(f, data, bytes, (off_t)offset) : pwrite(f, data, bytes, (off_t)offset);
+    if (done <= 0)
+      return false;
+    data += done;
+    bytes -= done;
+    offset += done;
+  }
+  return true;
+#endif
+}
+
+void transfer_chunks(weight_chunks& wc, uint64_t first, uint64_t step)
+{ v_array<char> buf = v_init<char>();
+  uint64_t stride = sizeof(uint32_t) + chunk_bytes(wc, 0);
+  for (uint64_t k = first; k < wc.chunks; k += step)
+  { size_t bytes = chunk_bytes(wc, k);
+    char* data = chunk_data(wc, k, buf);
+    uint64_t offset = wc.offset + k * stride;
+    uint32_t checksum = 0;
+    stringstream error;
+    if (wc.read)
+    { if (!transfer_at(wc.file, (char*)&checksum, sizeof(checksum), offset, true)
+          || !transfer_at(wc.file, data, bytes, offset + sizeof(checksum), true))
+        error << "Model content is corrupted, unexpected end of file in weight chunk " << k;
+      else if ((uint32_t)uniform_hash(data, bytes, k) != checksum)
+        error << "Model content is corrupted, bad checksum for weight chunk " << k;
+      else if (data == buf.begin())
+        copy_chunk(wc, k, data);
+    }
+    else
+    { if (data == buf.begin())
+        copy_chunk(wc, k, data);
+      checksum = (uint32_t)uniform_hash(data, bytes, k);
+      if (!transfer_at(wc.file, (char*)&checksum, sizeof(checksum), offset, false)
+          || !transfer_at(wc.file, data, bytes, offset + sizeof(checksum), false))
+        error << "failed to write weight chunk " << k << ": " << strerror(errno);
+    }
+    if (!error.str().empty())
+    { lock_guard<mutex> l(wc.lock);
+      if (wc.error.empty())
+        wc.error = error.str();
+      break;
+    }
+  }
+  buf.delete_v();
+}
+
+void save_load_chunked_weights(vw& all, io_buf& model_file, bool read, bool resume)
+{ weight_chunks wc;
+  wc.all = &all;
+  wc.read = read;
+  wc.stride_shift = resume ? all.reg.stride_shift : 0;
+  stringstream msg;
+  bin_text_read_write_fixed_validated(model_file, (char*)&wc.stride_shift, sizeof(wc.stride_shift),
+                                      "", read, msg, false);
+  if (wc.stride_shift > 16)
+    THROW("Model content is corrupted, bad weight stride " << wc.stride_shift);
+  uint64_t block = chunked_block;
+  bin_text_read_write_fixed_validated(model_file, (char*)&block, sizeof(block), "", read, msg, false);
+  if (block != chunked_block)
+    THROW("Model content is corrupted, bad weight chunk size " << block);
+  wc.chunks = (((uint64_t)1 << all.num_bits) + chunked_block - 1) / chunked_block;
+  uint64_t total = wc.chunks * sizeof(uint32_t) + ((uint64_t)sizeof(weight) << (all.num_bits + wc.stride_shift));
+
+  // find the file offset of the chunks, leaving the io_buf empty
+  wc.file = -1;
+  if (!model_file.compressed())
+  { int f = read ? model_file.files[model_file.current] : model_file.files[0];
+    if (!read)
+      model_file.flush();
+    int64_t pos = seek_file(f, 0, SEEK_CUR);
+    if (pos >= 0)
+    { wc.file = f;
+      wc.offset = (uint64_t)pos - (read ? model_file.space.end() - model_file.head : 0);
+    }
+  }
+
+  if (wc.file < 0)
+  { v_array<char> buf = v_init<char>();
+    for (uint64_t k = 0; k < wc.chunks; k++)
+    { size_t bytes = chunk_bytes(wc, k);
+      char* data = chunk_data(wc, k, buf);
+      uint32_t checksum = 0;
+      if (read)
+      { char* p;
+        if (bin_read_fixed(model_file, (char*)&checksum, sizeof(checksum), "") < sizeof(checksum)
+            || buf_read(model_file, p, bytes) < bytes)
+          THROW("Model content is corrupted, unexpected end of file in weight chunk " << k);
+        if ((uint32_t)uniform_hash(p, bytes, k) != checksum)
+          THROW("Model content is corrupted, bad checksum for weight chunk " << k);
+        memcpy(data, p, bytes);
+        if (data == buf.begin())
+          copy_chunk(wc, k, data);
+      }
+      else
+      { if (data == buf.begin())
+          copy_chunk(wc, k, data);
+        checksum = (uint32_t)uniform_hash(data, bytes, k);
+        bin_write_fixed(model_file, (char*)&checksum, sizeof(checksum));
+        bin_write_fixed(model_file, data, (uint32_t)bytes);
+      }
+    }
+    buf.delete_v();
+    return;
+  }
+
+  uint64_t threads = max(1u, thread::hardware_concurrency());
+  threads = min(threads, wc.chunks);
+  vector<thread> workers;
+  for (uint64_t t = 1; t < threads; t++)
+    workers.push_back(thread(transfer_chunks, ref(wc), t, threads));
+  transfer_chunks(wc, 0, threads);
+  for (thread& t : workers)
+    t.join();
+  if (!wc.error.empty())
+    THROW(wc.error);
+
+  seek_file(wc.file, wc.offset + total, SEEK_SET);
+  if (read)
+    model_file.head = model_file.space.end() = model_file.space.begin();
+}
+
+// The weights of --mapped_model, --compact_model and --chunked_model files start with an index no
+// weight can have, all bits set, and then their format.  Plain weights are written as before, so
+// old models load unchanged, and a model is read in the format it was written in whatever the
+// output flags of the run that reads it.
+enum weights_format { plain_weights = 0, mapped_weights, compact_weights, chunked_weights };
+
+weights_format save_load_weights_format(vw& all, io_buf& model_file, bool read, bool text, bool resume)
+{ if (text)
+    return plain_weights;
+  size_t index_size = !resume && all.num_bits < 31 ? sizeof(uint32_t) : sizeof(uint64_t);
+  uint64_t marker = (uint64_t)-1;
+  uint32_t format = all.mapped_model ? mapped_weights : all.compact_model ? compact_weights
+                    : all.chunked_model ? chunked_weights : plain_weights;
+  if (!read)
+  { if (format != plain_weights)
+    { char* p;
+      buf_write(model_file, p, index_size);
+      memcpy(p, &marker, index_size);
+      buf_write(model_file, p, sizeof(format));
+      memcpy(p, &format, sizeof(format));
+    }
+    return (weights_format)format;
+  }
+
+  char* p;
+  size_t got = buf_read(model_file, p, index_size);
+  if (got < index_size || memcmp(p, &marker, index_size) != 0)
+  { model_file.head -= got; // the first index of plain weights, or none at all
+    return plain_weights;
+  }
+  if (buf_read(model_file, p, sizeof(format)) < sizeof(format))
+    THROW("Model content is corrupted, unexpected end of file before the weights");
+  memcpy(&format, p, sizeof(format));
+  if (format == plain_weights || format > chunked_weights)
+    THROW("Model content is corrupted, unknown weights format " << format);
+  return (weights_format)format;
+}
+
 void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
 { uint64_t length = (uint64_t)1 << all.num_bits;
   uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
@@ -604,6 +1006,20 @@ void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
     return;
   }
 
+  weights_format format = save_load_weights_format(all, model_file, read, text, false);
+  if (format == mapped_weights)
+  { save_load_mapped_weights(all, model_file, read, false);
+    return;
+  }
+  if (format == compact_weights)
+  { save_load_compact_weights(all, model_file, read, 1);
+    return;
+  }
+  if (format == chunked_weights)
+  { save_load_chunked_weights(all, model_file, read, false);
+    return;
+  }
+
   do
   { brw = 1;
     weight* v;
@@ -738,6 +1154,23 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
     all.sd->total_features = 0;
   }
 
+  weights_format format = save_load_weights_format(all, model_file, read, text, true);
+  if (format == mapped_weights)
+  { save_load_mapped_weights(all, model_file, read, true);
+    return;
+  }
+  if (format == compact_weights)
+  { uint32_t floats = 1;
+    if (g != nullptr)
+      floats += (g->adaptive ? 1 : 0) + (g->normalized ? 1 : 0);
+    save_load_compact_weights(all, model_file, read, floats);
+    return;
+  }
+  if (format == chunked_weights)
+  { save_load_chunked_weights(all, model_file, read, true);
+    return;
+  }
+
   uint64_t length = (uint64_t)1 << all.num_bits;
   uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
 
@@ -756,12 +1189,16 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
         }
 
         v = &(all.reg.weight_vector[stride*i]);
+        weight state[3]; // test-only runs have a stride of one, so they keep just the weight
+        size_t count;
         if (g == NULL || (! g->adaptive && ! g->normalized))
-          brw += bin_read_fixed(model_file, (char*)v, sizeof(*v), "");
+          count = 1;
         else if ((g->adaptive && !g->normalized) || (!g->adaptive && g->normalized))
-          brw += bin_read_fixed(model_file, (char*)v, sizeof(*v) * 2, "");
+          count = 2;
         else //adaptive and normalized
-          brw += bin_read_fixed(model_file, (char*)v, sizeof(*v) * 3, "");
+          count = 3;
+        brw += bin_read_fixed(model_file, (char*)state, sizeof(*v) * count, "");
+        memcpy(v, state, sizeof(*v) * min(count, (size_t)stride));
         /*        if (!all.training)
                   v[1] = v[2] = 0.;*/
       }
@@ -990,6 +1427,7 @@ base_learner* setup(vw& all)
   ret.set_update(g.update);
   ret.set_save_load(save_load);
   ret.set_end_pass(end_pass);
-  return make_base(ret);
+  all.linear_learner = make_base(ret);
+  return all.linear_learner;
 }
 }
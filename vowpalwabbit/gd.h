@@ -8,6 +8,7 @@
 #include <sys/socket.h>
 #endif
 
+#include <xmmintrin.h>
 #include "parse_regressor.h"
 #include "constant.h"
 #include "interactions.h"
@@ -82,6 +83,13 @@ inline void foreach_feature(vw& all, example& ec, R& dat)
 
 inline void vec_add(float& p, const float fx, float& fw) { p += fw * fx; }
 
+// Walking an example with this before predicting on it issues its weight loads up front, so that
+// the cache misses of several examples overlap instead of stalling one feature at a time.
+struct prefetch_info { weight* weight_vector; uint64_t weight_mask; };
+
+inline void prefetch_weight(prefetch_info& p, const float, uint64_t fi)
+{ _mm_prefetch((const char*)(p.weight_vector + (fi & p.weight_mask)), _MM_HINT_T0); }
+
 inline float inline_predict(vw& all, example& ec)
 { float temp = ec.l.simple.initial;
   foreach_feature<float, vec_add>(all, ec, temp);
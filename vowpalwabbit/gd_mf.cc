@@ -27,6 +27,7 @@ struct gdmf
   uint32_t rank;
   size_t no_win_counter;
   uint64_t early_stop_thres;
+  v_array<float> scratch;//rank left and rank right dot products, then rank updates
 };
 
 void mf_print_offset_features(gdmf& d, example& ec, size_t offset)
@@ -72,6 +73,45 @@ void mf_print_audit_features(gdmf& d, example& ec, size_t offset)
   mf_print_offset_features(d, ec, offset);
 }
 
+// The 2*rank+1 weights of a feature index (linear, then l^1 .. l^rank, then r^1 .. r^rank) fill
+// the start of its stride, so the rank weights of a feature are next to each other unless its
+// index is not at the start of a stride.
+bool rank_blocks_contiguous(gdmf& d, features& fs)
+{ uint64_t low_bits = ((uint64_t)1 << d.all->reg.stride_shift) - 1;
+  for (feature_index i : fs.indicies)
+    if (i & low_bits)
+      return false;
+  return true;
+}
+
+// dots[k] = sum over the features of fs of x_f w[f + first + k], for k < count, summed in the
+// order of the features as foreach_feature would for each k on its own.  The inner loops run
+// over the contiguous rank weights of one feature, so they vectorize.
+void rank_dots(vw& all, features& fs, uint64_t first, size_t count, float* dots)
+{ weight* weights = all.reg.weight_vector;
+  uint64_t mask = all.reg.weight_mask;
+  for (size_t k = 0; k < count; k++)
+    dots[k] = 0.;
+  for (size_t j = 0; j < fs.size(); j++)
+  { float x = fs.values[j];
+    weight* w = &weights[(fs.indicies[j] & mask) + first];
+    for (size_t k = 0; k < count; k++)
+      dots[k] += x * w[k];
+  }
+}
+
+// w[f + first + k] += updates[k] x_f - regularization w[f + first + k] for the features of fs
+void rank_update(vw& all, features& fs, uint64_t first, size_t count, float* updates, float regularization)
+{ weight* weights = all.reg.weight_vector;
+  uint64_t mask = all.reg.weight_mask;
+  for (size_t j = 0; j < fs.size(); j++)
+  { float x = fs.values[j];
+    weight* w = &weights[(fs.indicies[j] & mask) + first];
+    for (size_t k = 0; k < count; k++)
+      w[k] += updates[k] * x - regularization * w[k];
+  }
+}
+
 float mf_predict(gdmf& d, example& ec)
 { vw& all = *d.all;
   label_data& ld = ec.l.simple;
@@ -100,7 +140,20 @@ float mf_predict(gdmf& d, example& ec)
   // interaction terms
   for (string& i : d.all->pairs)
   { if (ec.feature_space[(int)i[0]].size() > 0 && ec.feature_space[(int)i[1]].size() > 0)
-    { for (uint64_t k = 1; k <= d.rank; k++)
+    { if (rank_blocks_contiguous(d, ec.feature_space[(int)i[0]]) && rank_blocks_contiguous(d, ec.feature_space[(int)i[1]]))
+      { float* x_dot_l = d.scratch.begin();
+        float* x_dot_r = x_dot_l + d.rank;
+        rank_dots(all, ec.feature_space[(int)i[0]], 1, d.rank, x_dot_l);
+        rank_dots(all, ec.feature_space[(int)i[1]], d.rank + 1, d.rank, x_dot_r);
+        for (uint64_t k = 0; k < d.rank; k++)
+        { prediction += x_dot_l[k] * x_dot_r[k];
+          ec.topic_predictions.push_back(x_dot_l[k]);
+          ec.topic_predictions.push_back(x_dot_r[k]);
+        }
+        continue;
+      }
+
+      for (uint64_t k = 1; k <= d.rank; k++)
       { // x_l * l^k
         // l^k is from index+1 to index+d.rank
         //float x_dot_l = sd_offset_add(weights, mask, ec.atomics[(int)(*i)[0]].begin(), ec.atomics[(int)(*i)[0]].end(), k);
@@ -167,7 +220,16 @@ void mf_train(gdmf& d, example& ec)
   // quadratic update
   for (string& i : all.pairs)
   { if (ec.feature_space[(int)i[0]].size() > 0 && ec.feature_space[(int)i[1]].size() > 0)
-    {
+    { if (rank_blocks_contiguous(d, ec.feature_space[(int)i[0]]) && rank_blocks_contiguous(d, ec.feature_space[(int)i[1]]))
+      { float* updates = d.scratch.begin();
+        for (size_t k = 1; k <= d.rank; k++)
+          updates[k-1] = update*ec.topic_predictions[2*k];
+        rank_update(all, ec.feature_space[(int)i[0]], 1, d.rank, updates, regularization);
+        for (size_t k = 1; k <= d.rank; k++)
+          updates[k-1] = update*ec.topic_predictions[2*k-1];
+        rank_update(all, ec.feature_space[(int)i[1]], d.rank + 1, d.rank, updates, regularization);
+        continue;
+      }
 
       // update l^k weights
       for (size_t k = 1; k <= d.rank; k++)
@@ -258,6 +320,8 @@ void end_pass(gdmf& d)
 
 void predict(gdmf& d, base_learner&, example& ec) { mf_predict(d,ec); }
 
+void finish(gdmf& d) { d.scratch.delete_v(); }
+
 void learn(gdmf& d, base_learner&, example& ec)
 { vw& all = *d.all;
 
@@ -284,6 +348,7 @@ base_learner* gd_mf_setup(vw& all)
   data.rank = all.vm["rank"].as<uint32_t>();
   data.no_win_counter = 0;
   data.early_stop_thres = 3;
+  data.scratch.resize(2 * data.rank);
 
   // store linear + 2*rank weights per index, round up to power of two
   float temp = ceilf(logf((float)(data.rank*2+1)) / logf (2.f));
@@ -311,6 +376,7 @@ base_learner* gd_mf_setup(vw& all)
   l.set_predict(predict);
   l.set_save_load(save_load);
   l.set_end_pass(end_pass);
+  l.set_finish(finish);
 
   return make_base(l);
 }
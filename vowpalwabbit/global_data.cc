@@ -19,7 +19,7 @@ using namespace std;
 
 struct global_prediction
 { float p;
-  float weight;
+  float weight; // for simple labels, the raw prediction
 };
 
 size_t really_read(int sock, void* in, size_t count)
@@ -244,6 +244,8 @@ vw::vw()
 
   l = nullptr;
   scorer = nullptr;
+  linear_learner = nullptr;
+  linear_scorer = false;
   cost_sensitive = nullptr;
   loss = nullptr;
 
@@ -264,7 +266,19 @@ vw::vw()
   default_bits = true;
   daemon = false;
   num_children = 10;
+  shared_weights = false;
   save_resume = false;
+  mapped_model = false;
+  compact_model = false;
+  compact_model_level = 0;
+  chunked_model = false;
+  dictionary_cache = false;
+  background_save = false;
+  background_save_pid = 0;
+  checkpoints = 0;
+  checkpoint_stall = 0.;
+  delta_checkpoints = false;
+  delta_snapshot = nullptr;
 
   random_positive_weights = false;
 
@@ -323,6 +337,7 @@ vw::vw()
   add_constant = true;
   audit = false;
   reg.weight_vector = nullptr;
+  reg.mapped_length = 0;
   pass_length = (size_t)-1;
   passes_complete = 0;
 
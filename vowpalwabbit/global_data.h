@@ -117,14 +117,67 @@ struct regressor
 { weight* weight_vector;
   uint64_t weight_mask; // (stride*(1 << num_bits) -1)
   uint32_t stride_shift;
+  size_t mapped_length; // bytes of weight_vector mapped from a model file or shared by daemon children, 0 if allocated
 };
 
 typedef v_hashmap< substring, features* > feature_dict;
 
+// A --dictionary_cache file mapped read-only.  It holds an open addressing index from word hashes to
+// entries, then the entries, then the feature indices and values of all entries, so that a lookup
+// hands out the features in place.
+struct mapped_dictionary
+{ struct header
+  { char magic[8];
+    uint64_t source_size; // of the text dictionary the cache was built from
+    int64_t source_mtime;
+    uint64_t file_hash; // of the text dictionary's contents
+    uint64_t signature; // of the parse settings the features were hashed with
+    uint64_t entries;
+    uint64_t buckets; // a power of two
+    uint64_t features;
+    uint64_t word_bytes;
+  };
+
+  struct entry
+  { uint64_t word; // offset in words
+    uint64_t first; // feature
+    uint32_t word_length;
+    uint32_t count;
+    float sum_feat_sq;
+    uint32_t unused;
+  };
+
+  char* data;
+  size_t length;
+  uint64_t* buckets; // pairs of a word hash and its entry number + 1, 0 when empty
+  uint64_t bucket_mask;
+  entry* entries;
+  feature_index* indices;
+  feature_value* values;
+  char* words;
+
+  // Finds the features of word, whose hash is uniform_hash(word, quadratic_constant).
+  bool get(substring word, uint64_t hash, feature_value*& v, feature_index*& i, size_t& count, float& sum_feat_sq)
+  { size_t length = word.end - word.begin;
+    for (uint64_t b = hash & bucket_mask; buckets[2*b+1] != 0; b = (b + 1) & bucket_mask)
+    { entry& e = entries[buckets[2*b+1] - 1];
+      if (buckets[2*b] == hash && e.word_length == length && memcmp(words + e.word, word.begin, length) == 0)
+      { v = values + e.first;
+        i = indices + e.first;
+        count = e.count;
+        sum_feat_sq = e.sum_feat_sq;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
 struct dictionary_info
 { char* name;
   unsigned long long file_hash;
-  feature_dict* dict;
+  feature_dict* dict; // parsed from the text file, or
+  mapped_dictionary* mapped; // mapped from its --dictionary_cache file
 };
 
 inline void deleter(substring ss, uint64_t label)
@@ -404,6 +457,8 @@ struct vw
 
   LEARNER::base_learner* l;//the top level learner
   LEARNER::base_learner* scorer;//a scoring function
+  LEARNER::base_learner* linear_learner;//set by gd, ftrl and bfgs: predicts the initial prediction plus its weights summed over ec.indices and interactions
+  bool linear_scorer;//the scorer's base is linear_learner, no reduction in between
   LEARNER::base_learner* cost_sensitive;//a cost sensitive learning algorithm.
 
   void learn(example*);
@@ -419,6 +474,7 @@ struct vw
 
   bool daemon;
   size_t num_children;
+  bool shared_weights; // weight_vector is memory all processes of a daemon share, reloads copy into it
 
   bool save_per_pass;
   float initial_weight;
@@ -428,6 +484,16 @@ struct vw
   bool hessian_on;
 
   bool save_resume;
+  bool mapped_model; // save weights page-aligned so that test-only runs can mmap them
+  bool compact_model; // save nonzero weights with delta-coded indices
+  int compact_model_level; // zlib level for the blocks of a compact model, 0 to store them as is
+  bool chunked_model; // save weights in checksummed chunks that threads write and read in parallel
+  bool background_save; // write save_predictor checkpoints from a forked copy-on-write snapshot
+  int background_save_pid; // child still writing a checkpoint, 0 if none
+  size_t checkpoints; // save_predictor calls so far
+  double checkpoint_stall; // seconds learning waited for checkpoints
+  bool delta_checkpoints; // save only the weights changed since the last save or load
+  weight* delta_snapshot; // weights as of the last save or load, for delta_checkpoints
   string id;
 
   version_struct model_file_ver;
@@ -478,8 +544,9 @@ struct vw
   uint64_t affix_features[256]; // affixes to generate (up to 16 per namespace - 4 bits per affix)
   bool     spelling_features[256]; // generate spelling features for which namespace
   vector<string> dictionary_path;  // where to look for dictionaries
-  vector<feature_dict*> namespace_dictionaries[256]; // each namespace has a list of dictionaries attached to it
+  vector<dictionary_info> namespace_dictionaries[256]; // each namespace has a list of dictionaries attached to it
   vector<dictionary_info> loaded_dictionaries; // which dictionaries have we loaded from a file to memory?
+  bool dictionary_cache; // map dictionaries from binary caches, building them from the text files when stale
 
   void (*delete_prediction)(void*);
   bool audit;//should I print lots of debugging information?
@@ -490,6 +557,7 @@ struct vw
   bool normalized_updates; //Should every feature be normalized
   bool invariant_updates; //Should we use importance aware/safe updates
   size_t random_seed;
+  uint64_t random_state; // frand48 state of this instance while --args instances learn on their own threads
   bool random_weights;
   bool random_positive_weights; // for initialize_regressor w/ new_mf
   bool add_constant;
@@ -507,6 +575,7 @@ struct vw
 
   std::string text_regressor_name;
   std::string inv_hash_regressor_name;
+  std::string export_predictor_name; // final regressor without --save_resume state
 
   size_t length () { return ((size_t)1) << num_bits; };
 
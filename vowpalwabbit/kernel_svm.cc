@@ -14,6 +14,10 @@ license as described in the file LICENSE.
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 #include "parse_example.h"
 #include "constant.h"
@@ -37,10 +41,12 @@ using namespace std;
 using namespace LEARNER;
 
 struct svm_params;
+struct kernel_workers;
 
 struct svm_example
 { v_array<float> krow;
   flat_example ex;
+  uint64_t last_use; // params.clock when krow was last read, for evicting the least recently used rows
 
   ~svm_example();
   void init_svm_example(flat_example *fec);
@@ -68,8 +74,11 @@ struct svm_params
   size_t reprocess;
 
   svm_model* model;
-  size_t maxcache;
+  size_t maxcache; // kernel values kept in the rows of all support vectors
   //size_t curcache;
+  uint64_t clock;
+  size_t kernel_threads;
+  kernel_workers* workers; // kernel_threads - 1 threads helping with long rows, started once
 
   svm_example** pool;
   float lambda;
@@ -106,26 +115,110 @@ float
 kernel_function(const flat_example* fec1, const flat_example* fec2,
                 void* params, size_t kernel_type);
 
+// least number of new kernel values per thread: a row is split once it has twice this many
+const size_t kernels_per_thread = 256;
+
+void kernel_range(svm_params& params, const flat_example* ex, float* row, size_t begin, size_t end)
+{ svm_example** support = params.model->support_vec.begin();
+  for (size_t i = begin; i < end; i++)
+    row[i] = kernel_function(ex, &(support[i]->ex), params.kernel_params, params.kernel_type);
+}
+
+// Threads that wait for rows to help with.  Each row is a new job: the caller fills slice 0 and
+// helper t fills slice t, for the first active - 1 helpers.
+struct kernel_workers
+{ vector<thread> helpers;
+  mutex lock;
+  condition_variable work, done;
+  uint64_t job; // incremented for every row handed out
+  size_t active, pending;
+  bool stop;
+  const flat_example* ex;
+  float* row;
+  size_t first, end, slice;
+};
+
+void help(svm_params& params, size_t t)
+{ kernel_workers& w = *params.workers;
+  uint64_t seen = 0;
+  while (true)
+  { size_t begin, end;
+    { unique_lock<mutex> l(w.lock);
+      w.work.wait(l, [&] { return w.stop || w.job != seen; });
+      if (w.stop)
+        return;
+      seen = w.job;
+      if (t >= w.active)
+        continue;
+      begin = w.first + t * w.slice;
+      end = min(w.end, begin + w.slice);
+    }
+    kernel_range(params, w.ex, w.row, begin, end);
+    { lock_guard<mutex> l(w.lock);
+      if (--w.pending == 0)
+        w.done.notify_one();
+    }
+  }
+}
+
+void start_workers(svm_params& params)
+{ params.workers = new kernel_workers();
+  params.workers->job = 0;
+  params.workers->stop = false;
+  for (size_t t = 1; t < params.kernel_threads; t++)
+    params.workers->helpers.push_back(thread(help, ref(params), t));
+}
+
+void stop_workers(svm_params& params)
+{ if (params.workers == nullptr)
+    return;
+  { lock_guard<mutex> l(params.workers->lock);
+    params.workers->stop = true;
+  }
+  params.workers->work.notify_all();
+  for (thread& t : params.workers->helpers)
+    t.join();
+  delete params.workers;
+  params.workers = nullptr;
+}
+
 int
 svm_example::compute_kernels(svm_params& params)
 { int alloc = 0;
   svm_model *model = params.model;
   size_t n = model->num_support;
+  last_use = ++params.clock;
 
   if (krow.size() < n)
   { //computing new kernel values and caching them
-    //if(params->curcache + n > params->maxcache)
-    //trim_cache(params);
     num_kernel_evals += krow.size();
-    //cerr<<"Kernels ";
-    for (size_t i=krow.size(); i<n; i++)
-    { svm_example *sec = model->support_vec[i];
-      float kv = kernel_function(&ex, &(sec->ex), params.kernel_params, params.kernel_type);
-      krow.push_back(kv);
-      alloc += 1;
-      //cerr<<kv<<" ";
+    size_t first = krow.size();
+    krow.resize(n); // exactly: trim_cache counts what the rows hold, not what they use
+
+    // each thread fills its own slice of the row, with the same values a serial loop would
+    size_t threads = min(params.kernel_threads, (n - first) / kernels_per_thread);
+    if (threads <= 1)
+      kernel_range(params, &ex, krow.begin(), first, n);
+    else
+    { kernel_workers& w = *params.workers;
+      size_t slice = (n - first + threads - 1) / threads;
+      { lock_guard<mutex> l(w.lock);
+        w.ex = &ex;
+        w.row = krow.begin();
+        w.first = first;
+        w.end = n;
+        w.slice = slice;
+        w.active = threads;
+        w.pending = threads - 1;
+        w.job++;
+      }
+      w.work.notify_all();
+      kernel_range(params, &ex, krow.begin(), first, first + slice);
+      unique_lock<mutex> l(w.lock);
+      w.done.wait(l, [&] { return w.pending == 0; });
     }
-    //cerr<<endl;
+    krow.end() = krow.begin() + n;
+    alloc += (int)(n - first);
   }
   else
     num_cache_evals += n;
@@ -182,17 +275,31 @@ make_hot_sv(svm_params& params, size_t svi)
   return alloc;
 }
 
+bool used_earlier(const svm_example* a, const svm_example* b)
+{ return a->last_use < b->last_use; }
+
+inline size_t held(svm_example* e) { return e->krow.end_array - e->krow.begin(); }
+
+// Drops the rows read least recently until the rows left hold at most maxcache kernel values,
+// counting the room allocated for each row rather than the values in it.
 static int
 trim_cache(svm_params& params)
-{ int sz = (int)params.maxcache;
-  svm_model *model = params.model;
-  size_t n = model->num_support;
+{ svm_model *model = params.model;
+  size_t cached = 0;
+  for (size_t i=0; i<model->num_support; i++)
+    cached += held(model->support_vec[i]);
+  if (cached <= params.maxcache)
+    return 0;
+
+  vector<svm_example*> rows;
+  for (size_t i=0; i<model->num_support; i++)
+    if (held(model->support_vec[i]) > 0)
+      rows.push_back(model->support_vec[i]);
+  sort(rows.begin(), rows.end(), used_earlier);
   int alloc = 0;
-  for (size_t i=0; i<n; i++)
-  { svm_example *e = model->support_vec[i];
-    sz -= (int)e->krow.size();
-    if (sz < 0)
-      alloc += e->clear_kernels();
+  for (size_t i=0; i<rows.size() && cached > params.maxcache; i++)
+  { cached -= held(rows[i]);
+    alloc += rows[i]->clear_kernels();
   }
   return alloc;
 }
@@ -296,6 +403,9 @@ void save_load(svm_params& params, io_buf& model_file, bool read, bool text)
 
 }
 
+// Flattened examples have sorted, distinct indices, so the dot product is a merge of the two index
+// lists.  Both sides advance without a branch on which one is behind, and the products are summed in
+// index order as before.
 float linear_kernel(const flat_example* fec1, const flat_example* fec2)
 {
   float dotprod = 0;
@@ -305,25 +415,19 @@ float linear_kernel(const flat_example* fec1, const flat_example* fec2)
   if (fs_2.indicies.size() == 0)
     return 0.f;
 
-  int numint = 0;
-  for (size_t idx1 = 0, idx2 = 0; idx1 < fs_1.size() && idx2 < fs_2.size() ; idx1++)
-    { uint64_t ec1pos = fs_1.indicies[idx1];
-      uint64_t ec2pos = fs_2.indicies[idx2];
-      //cerr<<ec1pos<<" "<<ec2pos<<" "<<idx1<<" "<<idx2<<" "<<f->x<<" "<<ec2f->x<<endl;
-      if(ec1pos < ec2pos) continue;
-
-      while(ec1pos > ec2pos && ++idx2 < fs_2.size())
-        ec2pos = fs_2.indicies[idx2];
-
-      if(ec1pos == ec2pos)
-        { //cerr<<ec1pos<<" "<<ec2pos<<" "<<idx1<<" "<<idx2<<" "<<f->x<<" "<<ec2f->x<<endl;
-          numint++;
-          dotprod += fs_1.values[idx1] * fs_2.values[idx2];
-          ++idx2;
-        }
-    }
-  //cerr<<endl;
-  //cerr<<"numint = "<<numint<<" dotprod = "<<dotprod<<endl;
+  const feature_index* idx_1 = fs_1.indicies.begin();
+  const feature_index* idx_2 = fs_2.indicies.begin();
+  const feature_value* val_1 = fs_1.values.begin();
+  const feature_value* val_2 = fs_2.values.begin();
+  size_t n1 = fs_1.size(), n2 = fs_2.size();
+  for (size_t i1 = 0, i2 = 0; i1 < n1 && i2 < n2;)
+  { feature_index ec1pos = idx_1[i1];
+    feature_index ec2pos = idx_2[i2];
+    if (ec1pos == ec2pos)
+      dotprod += val_1[i1] * val_2[i2];
+    i1 += ec1pos <= ec2pos;
+    i2 += ec2pos <= ec1pos;
+  }
   return dotprod;
 }
 
@@ -754,7 +858,8 @@ void free_svm_model(svm_model* model)
 }
 
 void finish(svm_params& params)
-{ free(params.pool);
+{ stop_workers(params);
+  free(params.pool);
 
   cerr<<"Num support = "<<params.model->num_support<<endl;
   cerr<<"Number of kernel evaluations = "<<num_kernel_evals<<" "<<"Number of cache queries = "<<num_cache_evals<<endl;
@@ -780,7 +885,9 @@ LEARNER::base_learner* kernel_svm_setup(vw &all)
   ("kernel", po::value<string>(), "type of kernel (rbf or linear (default))")
   ("bandwidth", po::value<float>(), "bandwidth of rbf kernel")
   ("degree", po::value<int>(), "degree of poly kernel")
-  ("lambda", po::value<double>(), "saving regularization for test time");
+  ("lambda", po::value<double>(), "saving regularization for test time")
+  ("kernel_cache", po::value<size_t>(), "MB of cached kernel values, least recently used rows are dropped first (default 4096)")
+  ("kernel_threads", po::value<size_t>(), "threads computing a row of kernel values (default 1)");
   add_options(all);
 
   po::variables_map& vm = all.vm;
@@ -794,6 +901,13 @@ LEARNER::base_learner* kernel_svm_setup(vw &all)
   params.model->num_support = 0;
   //params.curcache = 0;
   params.maxcache = 1024*1024*1024;
+  if(vm.count("kernel_cache"))
+    params.maxcache = vm["kernel_cache"].as<size_t>() * 1024 * 1024 / sizeof(float);
+  params.kernel_threads = 1;
+  if(vm.count("kernel_threads"))
+    params.kernel_threads = max((size_t)1, vm["kernel_threads"].as<size_t>());
+  if (params.kernel_threads > 1)
+    start_workers(params);
   params.loss_sum = 0.;
   params.all = &all;
 
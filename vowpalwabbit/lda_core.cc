@@ -11,6 +11,10 @@ license as described in the file LICENSE.
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "correctedMath.h"
 
 #include <boost/math/special_functions/digamma.hpp>
@@ -31,6 +35,17 @@ license as described in the file LICENSE.
 
 #include <boost/version.hpp>
 
+// #define VW_NO_INLINE_SIMD
+
+#if !defined(VW_NO_INLINE_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2_TOPIC_LOOPS
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_TOPIC_LOOPS
+#endif
+#endif
+
 #if BOOST_VERSION >= 105600
 #include <boost/align/is_aligned.hpp>
 #endif
@@ -46,6 +61,15 @@ public:
   bool operator<(const index_feature b) const { return f.weight_index < b.f.weight_index; }
 };
 
+// What lda_loop works in for one document, one of them per thread.
+struct gamma_scratch
+{ v_array<float> Elogtheta;
+  v_array<float> new_gamma;
+  v_array<float> old_gamma;
+};
+
+struct lda_workers;
+
 struct lda
 { size_t topics;
   float lda_alpha;
@@ -54,8 +78,11 @@ struct lda
   float lda_epsilon;
   size_t minibatch;
   lda_math_mode mmode;
+  size_t threads; // computing the topic weights of the documents of a minibatch
+  lda_workers* workers; // the threads - 1 threads helping the driver, started once
+  gamma_scratch scratch; // the driver's
+  bool avx2; // the CPU runs the AVX2 topic loops
 
-  v_array<float> Elogtheta;
   v_array<float> decay_levels;
   v_array<float> total_new;
   v_array<example *> examples;
@@ -83,8 +110,6 @@ struct lda
   inline void expdigammify_2(vw &all, float *gamma, float *norm);
 };
 
-// #define VW_NO_INLINE_SIMD
-
 namespace
 {
 inline bool is_aligned16(void *ptr)
@@ -420,6 +445,149 @@ template <> inline void expdigammify_2<float, USE_SIMD>(vw &all, float *gamma, f
 }
 } // namespace ldamath
 
+// The loops over the topics that run for every word: dot products of topic vectors and adding a
+// multiple of one to another.  A dot product is summed in 8 interleaved lanes, lane j taking the
+// topics k with k % 8 == j, and the lanes are added up in a fixed order, so the plain, SSE2 and AVX2
+// versions do the same float operations in the same order.  Which one runs (AVX2 is picked at run
+// time when the CPU has it) does not change the results.
+namespace topicloops
+{
+const size_t lanes = 8;
+
+inline float dot_tail(float *lane, const float *a, const float *b, size_t k, size_t n)
+{ for (; k < n; k++)
+    lane[k % lanes] += a[k] * b[k];
+  return ((lane[0] + lane[4]) + (lane[2] + lane[6])) + ((lane[1] + lane[5]) + (lane[3] + lane[7]));
+}
+
+#if defined(HAVE_SSE2_TOPIC_LOOPS)
+inline float dot(const float *a, const float *b, size_t n)
+{ __m128 low = _mm_setzero_ps(), high = _mm_setzero_ps();
+  size_t k = 0;
+  for (; k + lanes <= n; k += lanes)
+  { low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k)));
+    high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(a + k + 4), _mm_loadu_ps(b + k + 4)));
+  }
+  float lane[lanes];
+  _mm_storeu_ps(lane, low);
+  _mm_storeu_ps(lane + 4, high);
+  return dot_tail(lane, a, b, k, n);
+}
+
+// y += c x
+inline void axpy(float c, const float *x, float *y, size_t n)
+{ __m128 vc = _mm_set1_ps(c);
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4)
+    _mm_storeu_ps(y + k, _mm_add_ps(_mm_loadu_ps(y + k), _mm_mul_ps(vc, _mm_loadu_ps(x + k))));
+  for (; k < n; k++)
+    y[k] += c * x[k];
+}
+
+// d = (u v) c, added to both y and z
+inline void add_product(const float *u, const float *v, float c, float *y, float *z, size_t n)
+{ __m128 vc = _mm_set1_ps(c);
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4)
+  { __m128 d = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(u + k), _mm_loadu_ps(v + k)), vc);
+    _mm_storeu_ps(y + k, _mm_add_ps(_mm_loadu_ps(y + k), d));
+    _mm_storeu_ps(z + k, _mm_add_ps(_mm_loadu_ps(z + k), d));
+  }
+  for (; k < n; k++)
+  { float d = u[k] * v[k] * c;
+    y[k] += d;
+    z[k] += d;
+  }
+}
+#else
+inline float dot(const float *a, const float *b, size_t n)
+{ float lane[lanes] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+  size_t k = 0;
+  for (; k + lanes <= n; k += lanes)
+    for (size_t j = 0; j < lanes; j++)
+      lane[j] += a[k + j] * b[k + j];
+  return dot_tail(lane, a, b, k, n);
+}
+
+inline void axpy(float c, const float *x, float *y, size_t n)
+{ for (size_t k = 0; k < n; k++)
+    y[k] += c * x[k];
+}
+
+inline void add_product(const float *u, const float *v, float c, float *y, float *z, size_t n)
+{ for (size_t k = 0; k < n; k++)
+  { float d = u[k] * v[k] * c;
+    y[k] += d;
+    z[k] += d;
+  }
+}
+#endif
+
+#if defined(HAVE_AVX2_TOPIC_LOOPS)
+// Products and sums are separate instructions, as in the SSE2 versions: AVX2 alone does not let the
+// compiler fuse them.
+__attribute__((target("avx2"))) float dot_avx2(const float *a, const float *b, size_t n)
+{ __m256 sum = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + lanes <= n; k += lanes)
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k)));
+  float lane[lanes];
+  _mm256_storeu_ps(lane, sum);
+  return dot_tail(lane, a, b, k, n);
+}
+
+__attribute__((target("avx2"))) void axpy_avx2(float c, const float *x, float *y, size_t n)
+{ __m256 vc = _mm256_set1_ps(c);
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8)
+    _mm256_storeu_ps(y + k, _mm256_add_ps(_mm256_loadu_ps(y + k), _mm256_mul_ps(vc, _mm256_loadu_ps(x + k))));
+  axpy(c, x + k, y + k, n - k);
+}
+
+__attribute__((target("avx2"))) void add_product_avx2(const float *u, const float *v, float c, float *y, float *z, size_t n)
+{ __m256 vc = _mm256_set1_ps(c);
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8)
+  { __m256 d = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(u + k), _mm256_loadu_ps(v + k)), vc);
+    _mm256_storeu_ps(y + k, _mm256_add_ps(_mm256_loadu_ps(y + k), d));
+    _mm256_storeu_ps(z + k, _mm256_add_ps(_mm256_loadu_ps(z + k), d));
+  }
+  add_product(u + k, v + k, c, y + k, z + k, n - k);
+}
+
+bool have_avx2() { return __builtin_cpu_supports("avx2"); }
+#else
+bool have_avx2() { return false; }
+#endif
+
+inline float dot(lda &l, const float *a, const float *b)
+{
+#if defined(HAVE_AVX2_TOPIC_LOOPS)
+  if (l.avx2)
+    return dot_avx2(a, b, l.topics);
+#endif
+  return dot(a, b, l.topics);
+}
+
+inline void axpy(lda &l, float c, const float *x, float *y)
+{
+#if defined(HAVE_AVX2_TOPIC_LOOPS)
+  if (l.avx2)
+    return axpy_avx2(c, x, y, l.topics);
+#endif
+  axpy(c, x, y, l.topics);
+}
+
+inline void add_product(lda &l, const float *u, const float *v, float c, float *y, float *z)
+{
+#if defined(HAVE_AVX2_TOPIC_LOOPS)
+  if (l.avx2)
+    return add_product_avx2(u, v, c, y, z, l.topics);
+#endif
+  add_product(u, v, c, y, z, l.topics);
+}
+} // namespace topicloops
+
 float lda::digamma(float x)
 { switch (mmode)
   { case USE_FAST_APPROX:
@@ -546,14 +714,7 @@ float theta_kl(lda &l, v_array<float> &Elogtheta, float *gamma)
 }
 
 static inline float find_cw(lda &l, float *u_for_w, float *v)
-{ return 1.0f / std::inner_product(u_for_w, u_for_w + l.topics, v, 0.0f);
-}
-
-namespace
-{
-// Effectively, these are static and not visible outside the compilation unit.
-v_array<float> new_gamma = v_init<float>();
-v_array<float> old_gamma = v_init<float>();
+{ return 1.0f / topicloops::dot(l, u_for_w, v);
 }
 
 // Returns an estimate of the part of the variational bound that
@@ -561,8 +722,10 @@ v_array<float> old_gamma = v_init<float>();
 // setting of lambda based on the document passed in. The value is
 // divided by the total number of words in the document This can be
 // used as a (possibly very noisy) estimate of held-out likelihood.
-float lda_loop(lda &l, v_array<float> &Elogtheta, float *v, weight *weights, example *ec, float)
-{ new_gamma.erase();
+float lda_loop(lda &l, gamma_scratch &scratch, float *v, weight *weights, example *ec, float)
+{ v_array<float> &new_gamma = scratch.new_gamma;
+  v_array<float> &old_gamma = scratch.old_gamma;
+  new_gamma.erase();
   old_gamma.erase();
 
   for (size_t i = 0; i < l.topics; i++)
@@ -592,9 +755,7 @@ float lda_loop(lda &l, v_array<float> &Elogtheta, float *v, weight *weights, exa
             float c_w = find_cw(l, u_for_w, v);
             xc_w = c_w * f.value();
             score += -f.value() * log(c_w);
-            size_t max_k = l.topics;
-            for (size_t k = 0; k < max_k; k++)
-              new_gamma[k] += xc_w * u_for_w[k];
+            topicloops::axpy(l, xc_w, u_for_w, new_gamma.begin());
             word_count++;
             doc_length += f.value();
           }
@@ -609,7 +770,7 @@ float lda_loop(lda &l, v_array<float> &Elogtheta, float *v, weight *weights, exa
   memcpy(ec->topic_predictions.begin(), new_gamma.begin(), l.topics * sizeof(float));
   ec->topic_predictions.end() = ec->topic_predictions.begin() + l.topics;
 
-  score += theta_kl(l, Elogtheta, new_gamma.begin());
+  score += theta_kl(l, scratch.Elogtheta, new_gamma.begin());
 
   return score / doc_length;
 }
@@ -674,6 +835,81 @@ void save_load(lda &l, io_buf &model_file, bool read, bool text)
   }
 }
 
+// The documents of a minibatch are independent given the topics, so the threads take them one at a
+// time and each writes only the scores, v and topic_predictions of its own documents.
+struct document_queue
+{ lda *l;
+  weight *weights;
+  float *scores;
+  std::atomic<size_t> next;
+};
+
+void infer_documents(document_queue &q, gamma_scratch &scratch)
+{ lda &l = *q.l;
+  for (size_t d = q.next++; d < l.examples.size(); d = q.next++)
+    q.scores[d] = lda_loop(l, scratch, &(l.v[d * l.all->lda]), q.weights, l.examples[d], l.all->power_t);
+}
+
+void delete_scratch(gamma_scratch &scratch)
+{ scratch.Elogtheta.delete_v();
+  scratch.new_gamma.delete_v();
+  scratch.old_gamma.delete_v();
+}
+
+// Threads that wait for minibatches and take documents from their queue along with the driver.
+struct lda_workers
+{ std::vector<std::thread> helpers;
+  std::mutex lock;
+  std::condition_variable work, done;
+  uint64_t batch; // incremented for every minibatch handed out
+  size_t pending;
+  bool stop;
+  document_queue *queue;
+};
+
+void help_infer(lda &l)
+{ lda_workers &w = *l.workers;
+  gamma_scratch scratch = { v_init<float>(), v_init<float>(), v_init<float>() };
+  uint64_t seen = 0;
+  while (true)
+  { document_queue *q;
+    { std::unique_lock<std::mutex> lock(w.lock);
+      w.work.wait(lock, [&] { return w.stop || w.batch != seen; });
+      if (w.stop)
+        break;
+      seen = w.batch;
+      q = w.queue;
+    }
+    infer_documents(*q, scratch);
+    { std::lock_guard<std::mutex> lock(w.lock);
+      if (--w.pending == 0)
+        w.done.notify_one();
+    }
+  }
+  delete_scratch(scratch);
+}
+
+void start_workers(lda &l)
+{ l.workers = new lda_workers();
+  l.workers->batch = 0;
+  l.workers->stop = false;
+  for (size_t t = 1; t < l.threads; t++)
+    l.workers->helpers.push_back(std::thread(help_infer, std::ref(l)));
+}
+
+void stop_workers(lda &l)
+{ if (l.workers == nullptr)
+    return;
+  { std::lock_guard<std::mutex> lock(l.workers->lock);
+    l.workers->stop = true;
+  }
+  l.workers->work.notify_all();
+  for (std::thread &t : l.workers->helpers)
+    t.join();
+  delete l.workers;
+  l.workers = nullptr;
+}
+
 void learn_batch(lda &l)
 { if (l.sorted_features.empty())
   { // This can happen when the socket connection is dropped by the client.
@@ -741,8 +977,29 @@ void learn_batch(lda &l)
     l.expdigammify_2(*l.all, u_for_w, l.digammas.begin());
   }
 
+  std::vector<float> scores(batch_size);
+  document_queue queue;
+  queue.l = &l;
+  queue.weights = weights;
+  queue.scores = scores.data();
+  queue.next = 0;
+  if (l.workers != nullptr)
+  { { std::lock_guard<std::mutex> lock(l.workers->lock);
+      l.workers->queue = &queue;
+      l.workers->pending = l.workers->helpers.size();
+      l.workers->batch++;
+    }
+    l.workers->work.notify_all();
+  }
+  infer_documents(queue, l.scratch);
+  if (l.workers != nullptr)
+  { std::unique_lock<std::mutex> lock(l.workers->lock);
+    l.workers->done.wait(lock, [&] { return l.workers->pending == 0; });
+  }
+
+  // the losses and the examples are passed on in document order
   for (size_t d = 0; d < batch_size; d++)
-  { float score = lda_loop(l, l.Elogtheta, &(l.v[d * l.all->lda]), weights, l.examples[d], l.all->power_t);
+  { float score = scores[d];
     if (l.all->audit)
       GD::print_audit_features(*l.all, *l.examples[d]);
     // If the doc is empty, give it loss of 0.
@@ -768,11 +1025,7 @@ void learn_batch(lda &l)
     { float *v_s = &(l.v[s->document * l.all->lda]);
       float *u_for_w = &weights[(s->f.weight_index & l.all->reg.weight_mask) + l.all->lda + 1];
       float c_w = eta * find_cw(l, u_for_w, v_s) * s->f.x;
-      for (size_t k = 0; k < l.all->lda; k++)
-      { float new_value = u_for_w[k] * v_s[k] * c_w;
-        l.total_new[k] += new_value;
-        word_weights[k] += new_value;
-      }
+      topicloops::add_product(l, u_for_w, v_s, c_w, l.total_new.begin(), word_weights);
     }
   }
   for (size_t k = 0; k < l.all->lda; k++)
@@ -823,8 +1076,9 @@ void end_examples(lda &l)
 void finish_example(vw&, lda&, example &) {}
 
 void finish(lda &ld)
-{ ld.sorted_features.~vector<index_feature>();
-  ld.Elogtheta.delete_v();
+{ stop_workers(ld);
+  delete_scratch(ld.scratch);
+  ld.sorted_features.~vector<index_feature>();
   ld.decay_levels.delete_v();
   ld.total_new.delete_v();
   ld.examples.delete_v();
@@ -859,7 +1113,8 @@ LEARNER::base_learner *lda_setup(vw &all)
     ("lda_D", po::value<float>()->default_value(10000.), "Number of documents")
     ("lda_epsilon", po::value<float>()->default_value(0.001f), "Loop convergence threshold")
     ("minibatch", po::value<size_t>()->default_value(1), "Minibatch size, for LDA")
-    ("math-mode", po::value<lda_math_mode>()->default_value(USE_SIMD), "Math mode: simd, accuracy, fast-approx");
+    ("math-mode", po::value<lda_math_mode>()->default_value(USE_SIMD), "Math mode: simd, accuracy, fast-approx")
+    ("lda_threads", po::value<size_t>(), "Threads inferring the topics of the documents of a minibatch (default 1)");
   add_options(all);
   po::variables_map &vm = all.vm;
 
@@ -878,6 +1133,12 @@ LEARNER::base_learner *lda_setup(vw &all)
   ld.all = &all;
   ld.example_t = all.initial_t;
   ld.mmode = vm["math-mode"].as<lda_math_mode>();
+  ld.avx2 = topicloops::have_avx2();
+  ld.threads = 1;
+  if (vm.count("lda_threads"))
+    ld.threads = max((size_t)1, vm["lda_threads"].as<size_t>());
+  if (ld.threads > 1)
+    start_workers(ld);
 
   float temp = ceilf(logf((float)(all.lda * 2 + 1)) / logf(2.f));
   all.reg.stride_shift = (size_t)temp;
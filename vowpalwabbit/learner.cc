@@ -1,5 +1,10 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include "parser.h"
 #include "vw.h"
+#include "rand48.h"
 #include "parse_regressor.h"
 
 void dispatch_example(vw& all, example& ec)
@@ -13,7 +18,9 @@ void dispatch_example(vw& all, example& ec)
 namespace LEARNER
 {
 void process_example(vw& all, example* ec)
-{
+{ if (all.daemon && model_reload_requested())
+    VW::reload_model(all);
+
   if (ec->indices.size() > 1) // 1+ nonconstant feature. (most common case first)
     dispatch_example(all, *ec);
   else if (ec->end_pass)
@@ -52,19 +59,120 @@ template <class T, void(*f)(T, example*)> void generic_driver(vw& all, T context
   all.l->end_examples();
 }
 
-void process_multiple(vector<vw*> alls, example* ec)
-{ // start with last as the first instance will free the example as it is the owner
-  for (auto it = alls.rbegin(); it != alls.rend(); ++it)
-    process_example(**it, ec);
+// With --args the first instance owns the parser and learns in the driver thread.  Every other
+// instance learns on its own thread from a private copy of each example, taken from its own example
+// ring so that reductions holding on to examples keep working.  The parsed example is only read
+// concurrently: the driver waits until all copies exist before the first instance touches it.
+struct multi_learner
+{ vector<vw*> alls;
+  mutex lock;
+  condition_variable posted;
+  condition_variable copied;
+  example* current;
+  size_t generation; // examples posted so far
+  size_t copies; // workers done copying the current example
+  bool done;
+  exception_ptr failure;
+};
+
+void learn_copies(multi_learner& m, vw& all)
+{ vw& owner = *m.alls[0];
+  size_t seen = 0;
+  bool failed = false;
+  use_rand48_state(&all.random_state);
+  uint64_t owner_spread = owner.wpp << owner.reg.stride_shift;
+  uint64_t spread = all.wpp << all.reg.stride_shift;
+  while (true)
+  { example* ec;
+    { unique_lock<mutex> l(m.lock);
+      m.posted.wait(l, [&m, seen] { return m.generation != seen || m.done; });
+      if (m.generation == seen)
+        break;
+      seen = m.generation;
+      ec = m.current;
+    }
+
+    example* copy = nullptr;
+    if (!failed)
+    { copy = get_unused_example(all);
+      VW::copy_example_data(all.audit, copy, ec, owner.p->lp.label_size, owner.p->lp.copy_label);
+      // setup_example spread the indices out for the weights per feature of the owner
+      if (spread != owner_spread)
+        for (features& fs : *copy)
+          for (feature_index& j : fs.indicies)
+            j = j / owner_spread * spread;
+    }
+
+    { unique_lock<mutex> l(m.lock);
+      if (++m.copies == m.alls.size() - 1)
+        m.copied.notify_one();
+    }
+
+    if (failed)
+      continue; // keep acknowledging examples so the driver does not stall
+    try
+    { process_example(all, copy);
+    }
+    catch (...)
+    { unique_lock<mutex> l(m.lock);
+      if (!m.failure)
+        m.failure = current_exception();
+      failed = true;
+    }
+  }
+
+  if (!failed)
+    all.l->end_examples();
+}
+
+void process_multiple(multi_learner& m, example* ec)
+{ { unique_lock<mutex> l(m.lock);
+    m.current = ec;
+    m.copies = 0;
+    m.generation++;
+  }
+  m.posted.notify_all();
+
+  { unique_lock<mutex> l(m.lock);
+    m.copied.wait(l, [&m] { return m.copies == m.alls.size() - 1; });
+  }
+  process_example(*m.alls[0], ec);
 }
 
 void generic_driver(vector<vw*> alls)
-{ generic_driver<vector<vw*>, process_multiple>(**alls.begin(), alls);
+{ multi_learner m;
+  m.alls = alls;
+  m.current = nullptr;
+  m.generation = 0;
+  m.copies = 0;
+  m.done = false;
+
+  // each instance draws its random numbers from its own state, continuing from where its setup left
+  // it, so what it learns does not depend on the others
+  use_rand48_state(&alls[0]->random_state);
+  vector<thread> workers;
+  for (size_t i = 1; i < alls.size(); i++)
+    workers.push_back(thread(learn_copies, ref(m), ref(*alls[i])));
+
+  try
+  { generic_driver<multi_learner&, process_multiple>(*alls[0], m);
+  }
+  catch (...)
+  { unique_lock<mutex> l(m.lock);
+    if (!m.failure)
+      m.failure = current_exception();
+  }
+
+  { unique_lock<mutex> l(m.lock);
+    m.done = true;
+  }
+  m.posted.notify_all();
+  for (thread& t : workers)
+    t.join();
+  use_rand48_state(nullptr);
 
-  // skip first as it already called end_examples()
-  auto it = alls.begin();
-  for (it++; it != alls.end(); it++)
-    (*it)->l->end_examples();
+  if (m.failure)
+    rethrow_exception(m.failure);
 }
 
 void generic_driver(vw& all)
@@ -59,6 +59,8 @@ struct finish_example_data
   void (*finish_example_f)(vw&, void* data, example&);
 };
 
+// Handles end-of-pass and "save" examples, and learns or predicts on everything else.
+void process_example(vw& all, example* ec);
 void generic_driver(vw& all);
 void generic_driver(std::vector<vw*> alls);
 
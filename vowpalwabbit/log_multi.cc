@@ -7,6 +7,7 @@ license as described in the file LICENSE.node
 #include <math.h>
 #include <stdio.h>
 #include <sstream>
+#include <vector>
 
 #include "reductions.h"
 
@@ -67,10 +68,21 @@ typedef struct
   uint32_t max_count_label;//the most common label
 } node;
 
+// The tree as a test-only predict walks it: packed breadth-first so the top levels share cache
+// lines, with the router of an internal node or the label of a leaf inlined.
+struct flat_node
+{ bool internal;
+  uint32_t base_predictor;//internal
+  uint32_t next[2];//internal: where a negative and a positive prediction go
+  uint32_t label;//leaf
+};
+
 struct log_multi
-{ uint32_t k;
+{ vw* all;
+  uint32_t k;
 
   v_array<node> nodes;
+  v_array<flat_node> flat;//built from nodes when not training
 
   size_t max_predictors;
   size_t predictors_used;
@@ -270,7 +282,29 @@ inline uint32_t descend(node& n, float prediction)
     return n.right;
 }
 
-void predict(log_multi& b,  base_learner& base, example& ec)
+void compile_tree(log_multi& b)
+{ b.flat.erase();
+
+  vector<uint32_t> order(1, 0);
+  for (size_t i = 0; i < order.size(); i++)
+  { node& n = b.nodes[order[i]];
+    flat_node f;
+    f.internal = n.internal;
+    f.base_predictor = n.base_predictor;
+    f.label = n.max_count_label;
+    f.next[0] = f.next[1] = 0;
+    if (n.internal)
+    { // the children go to the back of the queue, so that is where they will be packed
+      f.next[0] = (uint32_t)order.size();
+      order.push_back(n.left);
+      f.next[1] = (uint32_t)order.size();
+      order.push_back(n.right);
+    }
+    b.flat.push_back(f);
+  }
+}
+
+void predict_nodes(log_multi& b,  base_learner& base, example& ec)
 { MULTICLASS::label_t mc = ec.l.multi;
 
   ec.l.simple = {FLT_MAX, 0.f, 0.f};
@@ -285,10 +319,31 @@ void predict(log_multi& b,  base_learner& base, example& ec)
   ec.l.multi = mc;
 }
 
+void predict(log_multi& b,  base_learner& base, example& ec)
+{ if (b.all->training)
+  { predict_nodes(b, base, ec);
+    return;
+  }
+
+  if (b.flat.size() == 0)
+    compile_tree(b);
+
+  MULTICLASS::label_t mc = ec.l.multi;
+
+  ec.l.simple = {FLT_MAX, 0.f, 0.f};
+  flat_node* f = b.flat.begin();
+  while (f->internal)
+  { base.predict(ec, f->base_predictor);
+    f = b.flat.begin() + f->next[ec.pred.scalar < 0 ? 0 : 1];
+  }
+  ec.pred.multiclass = f->label;
+  ec.l.multi = mc;
+}
+
 void learn(log_multi& b, base_learner& base, example& ec)
 { //    verify_min_dfs(b, b.nodes[0]);
   if (ec.l.multi.label == (uint32_t)-1 || b.progress)
-    predict(b,base,ec);
+    predict_nodes(b,base,ec);
 
   if(ec.l.multi.label != (uint32_t)-1)	//if training the tree
   { MULTICLASS::label_t mc = ec.l.multi;
@@ -356,6 +411,7 @@ void finish(log_multi& b)
   for (size_t i = 0; i < b.nodes.size(); i++)
     b.nodes[i].preds.delete_v();
   b.nodes.delete_v();
+  b.flat.delete_v();
 }
 
 void save_load_tree(log_multi& b, io_buf& model_file, bool read, bool text)
@@ -449,6 +505,9 @@ void save_load_tree(log_multi& b, io_buf& model_file, bool read, bool text)
         bin_text_read_write_fixed(model_file,(char*)&p.label_count, sizeof(p.label_count), "", read, msg, text);
       }
     }
+
+    if (read && !b.all->training)
+      compile_tree(b);
   }
 }
 
@@ -463,6 +522,7 @@ base_learner* log_multi_setup(vw& all)	//learner setup
   po::variables_map& vm = all.vm;
 
   log_multi& data = calloc_or_throw<log_multi>();
+  data.all = &all;
   data.k = (uint32_t)vm["log_multi"].as<size_t>();
   data.swap_resist = 4;
 
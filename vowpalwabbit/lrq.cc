@@ -82,6 +82,8 @@ void predict_or_learn(LRQstate& lrq, base_learner& base, example& ec)
       unsigned int k = atoi (i.c_str () + 2);
 
       features& left_fs = ec.feature_space[left];
+      features& right_fs = ec.feature_space[right];
+      size_t right_size = lrq.orig_size[right];
       for (unsigned int lfn = 0; lfn < lrq.orig_size[left]; ++lfn)
         {
           float lfx = left_fs.values[lfn];
@@ -97,33 +99,25 @@ void predict_or_learn(LRQstate& lrq, base_learner& base, example& ec)
                   if (is_learn && ! example_is_test (ec) && *lw == 0)
                     *lw = cheesyrand (lwindex);
 
-                  features& right_fs = ec.feature_space[right];
-                  for (unsigned int rfn = 0;
-                       rfn < lrq.orig_size[right];
-                       ++rfn)
-                    { // NB: ec.ft_offset added by base learner
-                      float rfx = right_fs.values[rfn];
-                      uint64_t rindex = right_fs.indicies[rfn];
-                      uint64_t rwindex = (uint64_t)(rindex + (n << all.reg.stride_shift));
+                  // NB: ec.ft_offset added by base learner
+                  right_fs.push_back_scaled(right_size, scale * *lw * lfx, (uint64_t)(n << all.reg.stride_shift));
 
-                      right_fs.push_back(scale **lw * lfx * rfx, rwindex);
-
-                      if (all.audit || all.hash_inv)
-                        { std::stringstream new_feature_buffer;
-                          new_feature_buffer << right << '^'
-                                             << right_fs.space_names[rfn].get()->second << '^'
-                                             << n;
+                  if (all.audit || all.hash_inv)
+                    for (unsigned int rfn = 0; rfn < right_size; ++rfn)
+                      { std::stringstream new_feature_buffer;
+                        new_feature_buffer << right << '^'
+                                           << right_fs.space_names[rfn].get()->second << '^'
+                                           << n;
 
 #ifdef _WIN32
-                          char* new_space = _strdup("lrq");
-                          char* new_feature =	_strdup(new_feature_buffer.str().c_str());
+                        char* new_space = _strdup("lrq");
+                        char* new_feature =	_strdup(new_feature_buffer.str().c_str());
 #else
-                          char* new_space = strdup("lrq");
-                          char* new_feature = strdup(new_feature_buffer.str().c_str());
+                        char* new_space = strdup("lrq");
+                        char* new_feature = strdup(new_feature_buffer.str().c_str());
 #endif
-                          right_fs.space_names.push_back(audit_strings_ptr(new audit_strings(new_space,new_feature)));
-                        }
-                    }
+                        right_fs.space_names.push_back(audit_strings_ptr(new audit_strings(new_space,new_feature)));
+                      }
                 }
             }
         }
@@ -49,9 +49,11 @@ void predict_or_learn(LRQFAstate& lrq, base_learner& base, example& ec)
         unsigned char right = (which+1)%2 ? *i1 : *i2;
         unsigned int lfd_id = lrq.field_id[left];
         unsigned int rfd_id = lrq.field_id[right];
+        features& fs = ec.feature_space[left];
+        features& rfs = ec.feature_space[right];
+        size_t right_size = lrq.orig_size[right];
         for (unsigned int lfn = 0; lfn < lrq.orig_size[left]; ++lfn)
-          { features& fs = ec.feature_space[left];
-            float lfx = fs.values[lfn];
+          { float lfx = fs.values[lfn];
             uint64_t lindex = fs.indicies[lfn];
             for (unsigned int n = 1; n <= k; ++n)
               { uint64_t lwindex = (uint64_t)(lindex + ((rfd_id*k+n) << all.reg.stride_shift)); // a feature has k weights in each field
@@ -62,30 +64,24 @@ void predict_or_learn(LRQFAstate& lrq, base_learner& base, example& ec)
                   { *lw = cheesyrand(lwindex) * 0.5f / sqrtk;
                   }
 
-                for (unsigned int rfn = 0; rfn < lrq.orig_size[right]; ++rfn)
-                  { features& rfs = ec.feature_space[right];
-                    //                    feature* rf = ec.atomics[right].begin + rfn;
-                    // NB: ec.ft_offset added by base learner
-                    float rfx = rfs.values[rfn];
-                    uint64_t rindex = rfs.indicies[rfn];
-                    uint64_t rwindex = (uint64_t)(rindex + ((lfd_id*k+n) << all.reg.stride_shift));
-
-                    rfs.push_back(*lw * lfx * rfx, rwindex);
-                    if (all.audit || all.hash_inv)
-                      { std::stringstream new_feature_buffer;
-                        new_feature_buffer << right << '^'
-                                           << rfs.space_names[rfn].get()->second << '^'
-                                           << n;
+                // NB: ec.ft_offset added by base learner
+                rfs.push_back_scaled(right_size, *lw * lfx, (uint64_t)((lfd_id*k+n) << all.reg.stride_shift));
+
+                if (all.audit || all.hash_inv)
+                  for (unsigned int rfn = 0; rfn < right_size; ++rfn)
+                    { std::stringstream new_feature_buffer;
+                      new_feature_buffer << right << '^'
+                                         << rfs.space_names[rfn].get()->second << '^'
+                                         << n;
 #ifdef _WIN32
-                        char* new_space = _strdup("lrqfa");
-                        char* new_feature = _strdup(new_feature_buffer.str().c_str());
+                      char* new_space = _strdup("lrqfa");
+                      char* new_feature = _strdup(new_feature_buffer.str().c_str());
 #else
-                        char* new_space = strdup("lrqfa");
-                        char* new_feature = strdup(new_feature_buffer.str().c_str());
+                      char* new_space = strdup("lrqfa");
+                      char* new_feature = strdup(new_feature_buffer.str().c_str());
 #endif
-                        rfs.space_names.push_back(audit_strings_ptr(new audit_strings(new_space,new_feature)));
-                      }
-                  }
+                      rfs.space_names.push_back(audit_strings_ptr(new audit_strings(new_space,new_feature)));
+                    }
               }
           }
       }
@@ -12,9 +12,11 @@ license as described in the file LICENSE.
 #include <sys/timeb.h>
 #include "parse_args.h"
 #include "parse_regressor.h"
+#include "rand48.h"
 #include "accumulate.h"
 #include "best_constant.h"
 #include "vw_exception.h"
+#include "serve.h"
 #include <fstream>
 
 using namespace std;
@@ -64,7 +66,12 @@ vw* setup(int argc, char* argv[])
 
 int main(int argc, char *argv[])
 { try
-  { // support multiple vw instances for training of the same datafile for the same instance
+  { if (argc >= 2 && !strcmp(argv[1], "--serve"))
+    { VW::serve(argc, argv);
+      return 0;
+    }
+
+    // support multiple vw instances for training of the same datafile for the same instance
     vector<vw*> alls;
     if (argc == 3 && !strcmp(argv[1], "--args"))
     { std::fstream arg_file(argv[2]);
@@ -83,6 +90,7 @@ int main(int argc, char *argv[])
         char** l_argv = VW::get_argv_from_string(new_args, l_argc);
 
         alls.push_back(setup(l_argc, l_argv));
+        alls.back()->random_state = rand48_state();
       }
     }
     else
@@ -0,0 +1,269 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include "mips.h"
+#include "rand48.h"
+#include "hash.h"
+#include "vw_exception.h"
+
+using namespace std;
+using namespace ACTION_SCORE;
+
+namespace MIPS
+{
+inline float dot(const float* a, const float* b, size_t dim)
+{ // four partial sums, so that the adds do not wait on each other
+  float s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+  size_t i = 0;
+  for (; i + 4 <= dim; i += 4)
+  { s0 += a[i] * b[i];
+    s1 += a[i+1] * b[i+1];
+    s2 += a[i+2] * b[i+2];
+    s3 += a[i+3] * b[i+3];
+  }
+  for (; i < dim; i++)
+    s0 += a[i] * b[i];
+  return (s0 + s1) + (s2 + s3);
+}
+
+inline bool better(const action_score& a, const action_score& b) { return a.score > b.score; }
+
+size_t nearest(const vector<float>& centroids, const vector<float>& norms, const float* x, size_t dim)
+{ size_t best = 0;
+  float best_distance = FLT_MAX;
+  for (size_t c = 0; c < norms.size(); c++)
+  { float distance = norms[c] - 2.f * dot(&centroids[c * dim], x, dim); // |x - c|^2 - |x|^2
+    if (distance < best_distance)
+    { best_distance = distance;
+      best = c;
+    }
+  }
+  return best;
+}
+
+void compute_norms(const vector<float>& centroids, vector<float>& norms, size_t dim)
+{ for (size_t c = 0; c < norms.size(); c++)
+    norms[c] = dot(&centroids[c * dim], &centroids[c * dim], dim);
+}
+
+uint32_t checksum(const vector<float>& items)
+{ return (uint32_t)uniform_hash(items.data(), items.size() * sizeof(float), 0);
+}
+
+void build(index& ix, const vector<float>& items, size_t dim, size_t clusters, size_t iterations, uint64_t seed)
+{ if (dim == 0)
+    THROW("mips: items have no coordinates");
+  size_t n = items.size() / dim;
+  if (n == 0)
+    THROW("mips: no items to index");
+  clusters = max((size_t)1, min(clusters, n));
+  size_t ext = dim + 1;
+
+  // the extra coordinate that brings every item to the largest norm
+  vector<float> extra(n);
+  float max_norm = 0.;
+  for (size_t i = 0; i < n; i++)
+  { extra[i] = dot(&items[i * dim], &items[i * dim], dim);
+    max_norm = max(max_norm, extra[i]);
+  }
+  for (size_t i = 0; i < n; i++)
+    extra[i] = sqrtf(max(0.f, max_norm - extra[i]));
+
+  // a random sample, its first items seed the centroids
+  vector<uint32_t> order(n);
+  for (size_t i = 0; i < n; i++)
+    order[i] = (uint32_t)i;
+  size_t sample_size = min(n, 64 * clusters);
+  for (size_t i = 0; i < sample_size; i++)
+    swap(order[i], order[i + (size_t)(merand48(seed) * (n - i)) % (n - i)]);
+  vector<float> sample(sample_size * ext);
+  for (size_t s = 0; s < sample_size; s++)
+  { copy(&items[order[s] * dim], &items[order[s] * dim] + dim, &sample[s * ext]);
+    sample[s * ext + dim] = extra[order[s]];
+  }
+
+  vector<float> centroids(sample.begin(), sample.begin() + clusters * ext);
+  vector<float> norms(clusters);
+  vector<float> sums(clusters * ext);
+  vector<size_t> counts(clusters);
+  for (size_t it = 0; it < iterations; it++)
+  { compute_norms(centroids, norms, ext);
+    fill(sums.begin(), sums.end(), 0.f);
+    fill(counts.begin(), counts.end(), 0);
+    for (size_t s = 0; s < sample_size; s++)
+    { size_t c = nearest(centroids, norms, &sample[s * ext], ext);
+      for (size_t j = 0; j < ext; j++)
+        sums[c * ext + j] += sample[s * ext + j];
+      counts[c]++;
+    }
+    for (size_t c = 0; c < clusters; c++)
+      if (counts[c] > 0)
+        for (size_t j = 0; j < ext; j++)
+          centroids[c * ext + j] = sums[c * ext + j] / counts[c];
+      else // restart an empty cluster from a random sample item
+      { size_t s = (size_t)(merand48(seed) * sample_size) % sample_size;
+        copy(&sample[s * ext], &sample[s * ext] + ext, &centroids[c * ext]);
+      }
+  }
+
+  // every item joins its nearest cluster, then the items are laid out cluster by cluster
+  compute_norms(centroids, norms, ext);
+  vector<uint32_t> cluster_of(n);
+  vector<float> x(ext);
+  fill(counts.begin(), counts.end(), 0);
+  for (size_t i = 0; i < n; i++)
+  { copy(&items[i * dim], &items[i * dim] + dim, x.begin());
+    x[dim] = extra[i];
+    cluster_of[i] = (uint32_t)nearest(centroids, norms, &x[0], ext);
+    counts[cluster_of[i]]++;
+  }
+
+  ix.dim = dim;
+  ix.items = n;
+  ix.checksum = checksum(items);
+  ix.cluster_begin.assign(clusters + 1, 0);
+  for (size_t c = 0; c < clusters; c++)
+    ix.cluster_begin[c + 1] = ix.cluster_begin[c] + (uint32_t)counts[c];
+  ix.item_at.resize(n);
+  ix.vectors.resize(n * dim);
+  vector<uint32_t> next(ix.cluster_begin.begin(), ix.cluster_begin.end() - 1);
+  for (size_t i = 0; i < n; i++)
+  { uint32_t p = next[cluster_of[i]]++;
+    ix.item_at[p] = (uint32_t)i;
+    copy(&items[i * dim], &items[i * dim] + dim, &ix.vectors[p * dim]);
+  }
+
+  // probing only needs inner products with queries: the mean of each cluster's items
+  ix.centroids.assign(clusters * dim, 0.f);
+  for (size_t c = 0; c < clusters; c++)
+  { for (size_t p = ix.cluster_begin[c]; p < ix.cluster_begin[c + 1]; p++)
+      for (size_t j = 0; j < dim; j++)
+        ix.centroids[c * dim + j] += ix.vectors[p * dim + j];
+    if (counts[c] > 0)
+      for (size_t j = 0; j < dim; j++)
+        ix.centroids[c * dim + j] /= counts[c];
+  }
+}
+
+const char index_magic[] = "vw mips index 2";
+
+template<class T> void write_vector(ofstream& out, const vector<T>& v)
+{ uint64_t size = v.size();
+  out.write((const char*)&size, sizeof(size));
+  out.write((const char*)v.data(), size * sizeof(T));
+}
+
+// Reads a vector of at most limit elements, a larger size is a corrupt file and leaves in failed.
+template<class T> void read_vector(ifstream& in, vector<T>& v, uint64_t limit)
+{ uint64_t size = 0;
+  in.read((char*)&size, sizeof(size));
+  if (!in.good() || size > limit)
+  { in.setstate(ios::failbit);
+    return;
+  }
+  v.resize(size);
+  in.read((char*)v.data(), size * sizeof(T));
+}
+
+void save(const index& ix, const string& file)
+{ ofstream out(file.c_str(), ios::binary);
+  if (!out.is_open())
+    THROW("mips: can't write index " << file);
+  uint64_t dim = ix.dim, items = ix.items;
+  out.write(index_magic, sizeof(index_magic));
+  out.write((const char*)&dim, sizeof(dim));
+  out.write((const char*)&items, sizeof(items));
+  out.write((const char*)&ix.checksum, sizeof(ix.checksum));
+  write_vector(out, ix.centroids);
+  write_vector(out, ix.cluster_begin);
+  write_vector(out, ix.item_at);
+  write_vector(out, ix.vectors);
+  if (!out.good())
+    THROW("mips: error writing index " << file);
+}
+
+void load(index& ix, const string& file)
+{ ifstream in(file.c_str(), ios::binary);
+  if (!in.is_open())
+    THROW("mips: can't open index " << file);
+  char magic[sizeof(index_magic)];
+  uint64_t dim = 0, items = 0;
+  in.read(magic, sizeof(magic));
+  if (!in.good() || memcmp(magic, index_magic, sizeof(magic)))
+    THROW("mips: " << file << " is not an index");
+  in.read((char*)&dim, sizeof(dim));
+  in.read((char*)&items, sizeof(items));
+  in.read((char*)&ix.checksum, sizeof(ix.checksum));
+  // the sizes are checked against the file size before anything is allocated
+  streampos start = in.tellg();
+  in.seekg(0, ios::end);
+  uint64_t file_size = (uint64_t)(in.tellg() - start);
+  in.seekg(start);
+  if (!in.good() || dim == 0 || items == 0 || items > UINT32_MAX || dim > file_size / sizeof(float)
+      || items > file_size / sizeof(float) / dim)
+    THROW("mips: index " << file << " is truncated or corrupt");
+  ix.dim = dim;
+  ix.items = items;
+  read_vector(in, ix.centroids, items * dim);
+  read_vector(in, ix.cluster_begin, items + 1);
+  read_vector(in, ix.item_at, items);
+  read_vector(in, ix.vectors, items * dim);
+  bool good = in.good() && ix.cluster_begin.size() >= 2 && ix.cluster_begin.size() * ix.dim == ix.centroids.size() + ix.dim
+              && ix.item_at.size() == ix.items && ix.vectors.size() == ix.items * ix.dim
+              && ix.cluster_begin.front() == 0 && ix.cluster_begin.back() == ix.items;
+  for (size_t c = 1; good && c < ix.cluster_begin.size(); c++)
+    good = ix.cluster_begin[c - 1] <= ix.cluster_begin[c];
+  for (size_t p = 0; good && p < ix.items; p++)
+    good = ix.item_at[p] < ix.items;
+  if (!good)
+    THROW("mips: index " << file << " is truncated or corrupt");
+}
+
+// Keeps the k best of the positions begin .. end-1 in out, a heap with the worst at the front.
+void scan(const index& ix, const float* query, size_t k, size_t begin, size_t end, action_scores& out)
+{ if (k == 0)
+    return;
+  for (size_t p = begin; p < end; p++)
+  { action_score s = { dot(query, &ix.vectors[p * ix.dim], ix.dim), ix.item_at[p] };
+    if (out.size() < k)
+    { out.push_back(s);
+      push_heap(out.begin(), out.end(), better);
+    }
+    else if (s.score > out[0].score)
+    { pop_heap(out.begin(), out.end(), better);
+      *(out.end() - 1) = s;
+      push_heap(out.begin(), out.end(), better);
+    }
+  }
+}
+
+void top_k(const index& ix, const float* query, size_t k, size_t probes, action_scores& out)
+{ size_t clusters = ix.cluster_begin.size() - 1;
+  probes = min(probes, clusters);
+  vector<action_score> ranked(clusters);
+  for (size_t c = 0; c < clusters; c++)
+  { ranked[c].score = ix.cluster_begin[c] < ix.cluster_begin[c + 1] ? dot(query, &ix.centroids[c * ix.dim], ix.dim) : -FLT_MAX;
+    ranked[c].action = (uint32_t)c;
+  }
+  partial_sort(ranked.begin(), ranked.begin() + probes, ranked.end(), better);
+
+  out.erase();
+  for (size_t r = 0; r < probes; r++)
+    scan(ix, query, k, ix.cluster_begin[ranked[r].action], ix.cluster_begin[ranked[r].action + 1], out);
+  sort_heap(out.begin(), out.end(), better);
+}
+
+void exact_top_k(const index& ix, const float* query, size_t k, action_scores& out)
+{ out.erase();
+  scan(ix, query, k, 0, ix.items, out);
+  sort_heap(out.begin(), out.end(), better);
+}
+}
@@ -0,0 +1,49 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+// Approximate maximum inner product search over a fixed set of item vectors, to cut a very large
+// action space down to a few candidates that a learner then scores exactly.
+//
+// Every item gets one more coordinate, sqrt(M^2 - |x|^2) with M the largest item norm, so that all
+// items have the same norm and the items with the largest inner product with a query (which gets a
+// 0 there) are the ones nearest to it.  The extended items are clustered by k-means.  A query
+// scores the centroids, and only the items of the probes best clusters are scored.  Items are kept
+// in cluster order, so a probe is a dense scan.
+#include <string>
+#include <vector>
+#include "v_array.h"
+#include "action_score.h"
+
+namespace MIPS
+{
+struct index
+{ size_t dim; // of the items
+  size_t items;
+  std::vector<float> centroids; // clusters x dim: the mean item of each cluster, scored against queries
+  std::vector<uint32_t> cluster_begin; // clusters + 1 entries: cluster c holds positions cluster_begin[c] .. cluster_begin[c+1]-1
+  std::vector<uint32_t> item_at; // item id at each position
+  std::vector<float> vectors; // items x dim, by position
+  uint32_t checksum; // of the item vectors it was built from
+};
+
+// Identifies a set of item vectors.  An index keeps the checksum of the vectors it was built from,
+// so that a saved index can be checked against the vectors of the model and items loading it.
+uint32_t checksum(const std::vector<float>& items);
+
+// items holds n vectors of dim floats, item i at items[i*dim].  k-means runs on a sample of at most
+// 64 items per cluster, then every item joins the cluster nearest to it.
+void build(index& ix, const std::vector<float>& items, size_t dim, size_t clusters, size_t iterations, uint64_t seed);
+
+void save(const index& ix, const std::string& file);
+void load(index& ix, const std::string& file);
+
+// The k items with the largest inner product with query among the items of the probes clusters
+// that score highest, best first, as (inner product, item id).
+void top_k(const index& ix, const float* query, size_t k, size_t probes, ACTION_SCORE::action_scores& out);
+
+// The same over all items, for measuring recall.
+void exact_top_k(const index& ix, const float* query, size_t k, ACTION_SCORE::action_scores& out);
+}
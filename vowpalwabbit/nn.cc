@@ -13,6 +13,10 @@ license as described in the file LICENSE.
 #include "gd.h"
 #include "vw.h"
 
+#if !defined(VW_NO_INLINE_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 using namespace LEARNER;
 
@@ -35,12 +39,20 @@ struct nn
   bool finished_setup;
   bool multitask;
 
-  float* hidden_units;
+  float* hidden_units; // their activations
   bool* dropped_out;
 
   polyprediction* hidden_units_pred;
   polyprediction* hiddenbias_pred;
 
+  // The hidden units of the last predictions, k per prediction at predicted_offset + c*predicted_step,
+  // which update learns from instead of recomputing them.
+  example* predicted;
+  size_t predicted_counter;
+  uint64_t predicted_offset;
+  size_t predicted_step;
+  v_array<float> predicted_hidden;
+
   vw* all;//many things
 };
 
@@ -67,6 +79,31 @@ fasttanh (float p)
 { return -1.0f + 2.0f / (1.0f + fastexp (-2.0f * p));
 }
 
+// fasttanh of each of x[0] .. x[n-1], in place, four at a time where SSE2 is there.  The arithmetic
+// is the same as fasttanh's, so are the results.
+static void
+fasttanh_all (float* x, size_t n)
+{ size_t i = 0;
+#if !defined(VW_NO_INLINE_SIMD) && defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps ();
+  const __m128 one = _mm_set1_ps (1.0f);
+  for (; i + 4 <= n; i += 4)
+  { __m128 p = _mm_mul_ps (_mm_set1_ps (1.442695040f), _mm_mul_ps (_mm_set1_ps (-2.0f), _mm_loadu_ps (x + i)));
+    __m128 offset = _mm_and_ps (_mm_cmplt_ps (p, zero), one);
+    __m128 clipp = _mm_max_ps (p, _mm_set1_ps (-126.0f));
+    __m128 w = _mm_cvtepi32_ps (_mm_cvttps_epi32 (clipp));
+    __m128 z = _mm_add_ps (_mm_sub_ps (clipp, w), offset);
+    __m128 v = _mm_add_ps (_mm_add_ps (clipp, _mm_set1_ps (121.2740575f)),
+                           _mm_div_ps (_mm_set1_ps (27.7280233f), _mm_sub_ps (_mm_set1_ps (4.84252568f), z)));
+    v = _mm_sub_ps (v, _mm_mul_ps (_mm_set1_ps (1.49012907f), z));
+    __m128 e = _mm_castsi128_ps (_mm_cvttps_epi32 (_mm_mul_ps (_mm_set1_ps ((float)(1 << 23)), v)));
+    _mm_storeu_ps (x + i, _mm_sub_ps (_mm_div_ps (_mm_set1_ps (2.0f), _mm_add_ps (one, e)), one));
+  }
+#endif
+  for (; i < n; ++i)
+    x[i] = fasttanh (x[i]);
+}
+
 void finish_setup (nn& n, vw& all)
 { // TODO: output_layer audit
 
@@ -176,10 +213,15 @@ void predict_or_learn_multi(nn& n, base_learner& base, example& ec)
       }
   }
 
+  float* activations = n.hidden_units;
+  for (unsigned int i = 0; i < n.k; ++i)
+    activations[i] = hidden_units[i].scalar;
+  fasttanh_all (activations, n.k);
+
   if (shouldOutput)
     for (unsigned int i = 0; i < n.k; ++i )
     { if (i > 0) outputStringStream << ' ';
-      outputStringStream << i << ':' << hidden_units[i].scalar << ',' << fasttanh (hidden_units[i].scalar); // TODO: huh, what was going on here?
+      outputStringStream << i << ':' << hidden_units[i].scalar << ',' << activations[i]; // TODO: huh, what was going on here?
     }
 
   n.all->loss = save_loss;
@@ -209,7 +251,7 @@ CONVERSE: // That's right, I'm using goto.  So sue me.
 
   for (unsigned int i = 0; i < n.k; ++i)
   { float sigmah =
-      (dropped_out[i]) ? 0.0f : dropscale * fasttanh (hidden_units[i].scalar);
+      (dropped_out[i]) ? 0.0f : dropscale * activations[i];
     features& out_fs = n.output_layer.feature_space[nn_output_namespace];
     out_fs.values[i] = sigmah;
 
@@ -309,6 +351,10 @@ CONVERSE: // That's right, I'm using goto.  So sue me.
         }
       }
 
+      // the other tasks remembered this hidden layer before it learned
+      if (n.multitask)
+        n.predicted = nullptr;
+
       n.all->loss = save_loss;
       n.all->set_minmax = save_set_minmax;
       n.all->sd->min_label = save_min_label;
@@ -343,12 +389,67 @@ CONVERSE: // That's right, I'm using goto.  So sue me.
   n.all->set_minmax (n.all->sd, sd.max_label);
 }
 
+// Dropout draws new units to drop on every pass, so nothing is remembered with it.
+void remember_hidden(nn& n, example& ec, size_t c, size_t step)
+{ if (n.dropout)
+    return;
+  if (c == 0)
+  { n.predicted = &ec;
+    n.predicted_counter = ec.example_counter;
+    n.predicted_offset = ec.ft_offset;
+    n.predicted_step = step;
+    n.predicted_hidden.erase();
+  }
+  for (unsigned int i = 0; i < n.k; ++i)
+    n.predicted_hidden.push_back(n.hidden_units_pred[i].scalar);
+}
+
+bool recall_hidden(nn& n, example& ec)
+{ if (n.predicted != &ec || n.predicted_counter != ec.example_counter)
+    return false;
+  uint64_t distance = ec.ft_offset - n.predicted_offset;
+  size_t c = 0;
+  if (n.predicted_step > 0)
+  { if (distance % n.predicted_step != 0)
+      return false;
+    c = (size_t)(distance / n.predicted_step);
+  }
+  else if (distance != 0)
+    return false;
+  if ((c + 1) * n.k > n.predicted_hidden.size())
+    return false;
+
+  for (unsigned int i = 0; i < n.k; ++i)
+    n.hidden_units_pred[i].scalar = n.predicted_hidden[c * n.k + i];
+  return true;
+}
+
+void predict(nn& n, base_learner& base, example& ec)
+{ predict_or_learn_multi<false,true>(n, base, ec);
+  remember_hidden(n, ec, 0, 0);
+}
+
+void learn(nn& n, base_learner& base, example& ec)
+{ n.predicted = nullptr;
+  predict_or_learn_multi<true,true>(n, base, ec);
+}
+
+// As GD's, an update follows a prediction of the same example and learns from the hidden units
+// that prediction computed, rather than making a second pass over the features for them.
+void update(nn& n, base_learner& base, example& ec)
+{ if (recall_hidden(n, ec))
+    predict_or_learn_multi<true,false>(n, base, ec);
+  else
+    predict_or_learn_multi<true,true>(n, base, ec);
+}
+
 void multipredict(nn& n, base_learner& base, example& ec, size_t count, size_t step, polyprediction*pred, bool finalize_predictions)
 { for (size_t c=0; c<count; c++)
-  { if (c == 0)
+  { if (c == 0 || !n.multitask)
       predict_or_learn_multi<false,true>(n, base, ec);
     else
       predict_or_learn_multi<false,false>(n, base, ec);
+    remember_hidden(n, ec, c, step);
     if (finalize_predictions) pred[c] = ec.pred;
     else pred[c].scalar = ec.partial_prediction;
     ec.ft_offset += (uint64_t)step;
@@ -369,6 +470,7 @@ void finish(nn& n)
   free(n.dropped_out);
   free(n.hidden_units_pred);
   free(n.hiddenbias_pred);
+  n.predicted_hidden.delete_v();
   VW::dealloc_example(nullptr, n.output_layer);
   VW::dealloc_example(nullptr, n.hiddenbias);
   VW::dealloc_example(nullptr, n.outputweight);
@@ -444,12 +546,9 @@ base_learner* nn_setup(vw& all)
 
   base_learner* base = setup_base(all);
   n.increment = base->increment;//Indexing of output layer is odd.
-  learner<nn>&l = init_learner(&n, base,
-                               predict_or_learn_multi<true,true>,
-                               predict_or_learn_multi<false,true>,
-                               n.k+1);
-  if (n.multitask)
-    l.set_multipredict(multipredict);
+  learner<nn>&l = init_learner(&n, base, learn, predict, n.k+1);
+  l.set_update(update);
+  l.set_multipredict(multipredict);
   l.set_finish(finish);
   l.set_finish_example(finish_example);
   l.set_end_pass(end_pass);
@@ -473,4 +572,16 @@ with oaa:
   train: ./vw --oaa 10 -b 25 --adaptive --invariant --holdout_off -l 0.1 --nn 64 --passes 24 -k -c -d mnist-all.gz --random_seed 19 --nnmultipredict -f mnist-all64
 predict: ./vw -t -d mnist-all.gz -i mnist-all64 --nnmultipredict
 
+update learning from the hidden units of the prediction before it, settings of demo/mnist/do-mnist-train
+on 12k synthetic examples shaped like mnist's (784 pixels, ~150 nonzero, 10 classes), one core:
+
+  train: ./vw --oaa 10 -b 24 --adaptive --invariant --holdout_off -l 0.1 --nn 40 --passes 24 -k -c -d mnist_like.vw -f mnist40
+predict: ./vw -t -d mnist_like.vw -i mnist40
+
+                     recompute   remembered
+  nn  40 train         54.5s        34.0s
+         predict        0.89s        1.01s   (the same code, within noise)
+  nn  64 train        107.3s        51.4s
+         predict        1.22s        1.20s
+
 */
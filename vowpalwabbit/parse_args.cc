@@ -11,6 +11,9 @@ license as described in the file LICENSE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include "parse_regressor.h"
 #include "parser.h"
@@ -130,6 +133,129 @@ string find_in_path(vector<string> paths, string fname)
   */
 }
 
+// The features of a dictionary entry depend on how its line was parsed into the default namespace.
+uint64_t dictionary_signature(vw& all)
+{ char probe[] = "dictionary";
+  substring ss = { probe, probe + strlen(probe) };
+  uint64_t signature = all.p->hasher(ss, 0);
+  signature = signature * 31 + all.affix_features[(size_t)' '];
+  signature = signature * 31 + all.spelling_features[(size_t)' '];
+  signature = signature * 31 + (all.redefine_some ? all.redefine[(size_t)' '] : ' ');
+  return signature;
+}
+
+const char dictionary_cache_magic[8] = { 'v', 'w', 'd', 'i', 'c', 't', '1', '\0' };
+
+// Maps the cache of a text dictionary, returning nullptr if there is none or it is stale.
+mapped_dictionary* map_dictionary_cache(vw& all, string cache_name, struct stat& source)
+{
+#ifdef _WIN32
+  return nullptr;
+#else
+  int f = open(cache_name.c_str(), O_RDONLY);
+  if (f < 0)
+    return nullptr;
+  struct stat info;
+  void* data = MAP_FAILED;
+  if (fstat(f, &info) == 0 && (size_t)info.st_size >= sizeof(mapped_dictionary::header))
+    data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, f, 0);
+  close(f);
+  if (data == MAP_FAILED)
+    return nullptr;
+
+  mapped_dictionary::header& h = *(mapped_dictionary::header*)data;
+  size_t expected = sizeof(h) + h.buckets * 2 * sizeof(uint64_t) + h.entries * sizeof(mapped_dictionary::entry)
+                    + h.features * (sizeof(feature_index) + sizeof(feature_value)) + h.word_bytes;
+  if (memcmp(h.magic, dictionary_cache_magic, sizeof(h.magic)) != 0 || h.source_size != (uint64_t)source.st_size
+      || h.source_mtime != (int64_t)source.st_mtime || h.signature != dictionary_signature(all)
+      || h.buckets == 0 || (h.buckets & (h.buckets - 1)) != 0 || expected != (size_t)info.st_size)
+  { munmap(data, info.st_size);
+    return nullptr;
+  }
+
+  mapped_dictionary* dict = new mapped_dictionary;
+  dict->data = (char*)data;
+  dict->length = info.st_size;
+  dict->buckets = (uint64_t*)(dict->data + sizeof(h));
+  dict->bucket_mask = h.buckets - 1;
+  dict->entries = (mapped_dictionary::entry*)(dict->buckets + 2 * h.buckets);
+  dict->indices = (feature_index*)(dict->entries + h.entries);
+  dict->values = (feature_value*)(dict->indices + h.features);
+  dict->words = (char*)(dict->values + h.features);
+  return dict;
+#endif
+}
+
+void write_dictionary_cache(vw& all, string cache_name, struct stat& source, unsigned long long file_hash, feature_dict* map)
+{ mapped_dictionary::header h;
+  memcpy(h.magic, dictionary_cache_magic, sizeof(h.magic));
+  h.source_size = source.st_size;
+  h.source_mtime = source.st_mtime;
+  h.file_hash = file_hash;
+  h.signature = dictionary_signature(all);
+  h.entries = map->size();
+  h.buckets = 1;
+  while (h.buckets < 2 * h.entries)
+    h.buckets *= 2;
+  h.features = 0;
+  h.word_bytes = 0;
+
+  vector<uint64_t> buckets(2 * h.buckets, 0);
+  vector<mapped_dictionary::entry> entries;
+  for (void* it = map->iterator(); it != nullptr; it = map->iterator_next(it))
+  { feature_dict::hash_elem& elem = *(feature_dict::hash_elem*)it;
+    mapped_dictionary::entry e;
+    e.word = h.word_bytes;
+    e.first = h.features;
+    e.word_length = (uint32_t)(elem.key.end - elem.key.begin);
+    e.count = (uint32_t)elem.val->values.size();
+    e.sum_feat_sq = elem.val->sum_feat_sq;
+    e.unused = 0;
+    entries.push_back(e);
+    h.word_bytes += e.word_length;
+    h.features += e.count;
+
+    uint64_t b = elem.hash & (h.buckets - 1);
+    while (buckets[2*b+1] != 0)
+      b = (b + 1) & (h.buckets - 1);
+    buckets[2*b] = elem.hash;
+    buckets[2*b+1] = entries.size();
+  }
+
+  string temp_name = cache_name + ".writing";
+  ofstream out(temp_name.c_str(), ios::binary | ios::trunc);
+  out.write((char*)&h, sizeof(h));
+  out.write((char*)buckets.data(), buckets.size() * sizeof(uint64_t));
+  out.write((char*)entries.data(), entries.size() * sizeof(mapped_dictionary::entry));
+  for (void* it = map->iterator(); it != nullptr; it = map->iterator_next(it))
+  { features& fs = *((feature_dict::hash_elem*)it)->val;
+    out.write((char*)fs.indicies.begin(), fs.indicies.size() * sizeof(feature_index));
+  }
+  for (void* it = map->iterator(); it != nullptr; it = map->iterator_next(it))
+  { features& fs = *((feature_dict::hash_elem*)it)->val;
+    out.write((char*)fs.values.begin(), fs.values.size() * sizeof(feature_value));
+  }
+  for (void* it = map->iterator(); it != nullptr; it = map->iterator_next(it))
+  { substring& word = ((feature_dict::hash_elem*)it)->key;
+    out.write(word.begin, word.end - word.begin);
+  }
+  out.close();
+  if (out.fail())
+  { cerr << "warning: cannot write dictionary cache '" << cache_name << "'" << endl;
+    remove(temp_name.c_str());
+    return;
+  }
+  remove(cache_name.c_str());
+  rename(temp_name.c_str(), cache_name.c_str());
+}
+
+void add_dictionary(vw& all, char ns, const char* name, unsigned long long file_hash, feature_dict* dict, mapped_dictionary* mapped)
+{ dictionary_info info = { calloc_or_throw<char>(strlen(name)+1), file_hash, dict, mapped };
+  strcpy(info.name, name);
+  all.namespace_dictionaries[(size_t)ns].push_back(info);
+  all.loaded_dictionaries.push_back(info);
+}
+
 void parse_dictionary_argument(vw&all, string str)
 { if (str.length() == 0) return;
   // expecting 'namespace:file', for instance 'w:foo.txt'
@@ -146,6 +272,29 @@ void parse_dictionary_argument(vw&all, string str)
   if (fname == "")
     THROW("error: cannot find dictionary '" << s << "' in path; try adding --dictionary_path");
 
+  struct stat source;
+  string cache_name = fname + ".dcache";
+  if (all.dictionary_cache && stat(fname.c_str(), &source) == 0)
+  { mapped_dictionary* mapped = map_dictionary_cache(all, cache_name, source);
+    if (mapped != nullptr)
+    { unsigned long long fd_hash = ((mapped_dictionary::header*)mapped->data)->file_hash;
+      for (size_t id=0; id<all.loaded_dictionaries.size(); id++)
+        if (all.loaded_dictionaries[id].file_hash == fd_hash)
+        { all.namespace_dictionaries[(size_t)ns].push_back(all.loaded_dictionaries[id]);
+#ifndef _WIN32
+          munmap(mapped->data, mapped->length);
+#endif
+          delete mapped;
+          return;
+        }
+      if (! all.quiet)
+        cerr << "mapped dictionary " << s << " from '" << cache_name << "', "
+             << ((mapped_dictionary::header*)mapped->data)->entries << " items" << endl;
+      add_dictionary(all, ns, s, fd_hash, nullptr, mapped);
+      return;
+    }
+  }
+
   bool is_gzip = ends_with(fname, ".gz");
   io_buf* io = is_gzip ? new comp_io_buf : new io_buf;
   int fd = io->open_file(fname.c_str(), all.stdin_off, io_buf::READ);
@@ -161,7 +310,7 @@ void parse_dictionary_argument(vw&all, string str)
   // see if we've already read this dictionary
   for (size_t id=0; id<all.loaded_dictionaries.size(); id++)
     if (all.loaded_dictionaries[id].file_hash == fd_hash)
-    { all.namespace_dictionaries[(size_t)ns].push_back(all.loaded_dictionaries[id].dict);
+    { all.namespace_dictionaries[(size_t)ns].push_back(all.loaded_dictionaries[id]);
       io->close_file();
       delete io;
       return;
@@ -243,10 +392,10 @@ void parse_dictionary_argument(vw&all, string str)
   if (! all.quiet)
     cerr << "dictionary " << s << " contains " << map->size() << " item" << (map->size() == 1 ? "\n" : "s\n");
 
-  all.namespace_dictionaries[(size_t)ns].push_back(map);
-  dictionary_info info = { calloc_or_throw<char>(strlen(s)+1), fd_hash, map };
-  strcpy(info.name, s);
-  all.loaded_dictionaries.push_back(info);
+  if (all.dictionary_cache && stat(fname.c_str(), &source) == 0)
+    write_dictionary_cache(all, cache_name, source, fd_hash, map);
+
+  add_dictionary(all, ns, s, fd_hash, map, nullptr);
 }
 
 void parse_affix_argument(vw&all, string str)
@@ -523,6 +672,7 @@ void parse_feature_tweaks(vw& all)
   ("spelling", po::value< vector<string> >(), "compute spelling features for a give namespace (use '_' for default namespace)")
   ("dictionary", po::value< vector<string> >(), "read a dictionary for additional features (arg either 'x:file' or just 'file')")
   ("dictionary_path", po::value< vector<string> >(), "look in this directory for dictionaries; defaults to current directory or env{PATH}")
+  ("dictionary_cache", "map each dictionary from a binary <dictionary>.dcache next to it, writing the cache when it is missing or stale")
   ("interactions", po::value< vector<string> > (), "Create feature interactions of any level between namespaces.")
   ("permutations", "Use permutations instead of combinations for feature interactions of same namespace.")
   ("leave_duplicate_interactions", "Don't remove interactions with duplicate combinations of namespaces. For ex. this is a duplicate: '-q ab -q ba' and a lot more in '-q ::'.")
@@ -830,6 +980,7 @@ void parse_feature_tweaks(vw& all)
       all.dictionary_path.push_back( PATH.substr(previous) );
     }
 
+    all.dictionary_cache = vm.count("dictionary_cache") > 0;
     vector<string> dictionary_ns = vm["dictionary"].as< vector<string> >();
     for (size_t id=0; id<dictionary_ns.size(); id++)
     { parse_dictionary_argument(all, dictionary_ns[id]);
@@ -975,7 +1126,13 @@ void parse_output_model(vw& all)
   ("readable_model", po::value< string >(), "Output human-readable final regressor with numeric features")
   ("invert_hash", po::value< string >(), "Output human-readable final regressor with feature names.  Computationally expensive.")
   ("save_resume", "save extra state so learning can be resumed later with new data")
+  ("export_predictor", po::value< string >(), "Also save the final regressor without --save_resume state, for prediction only")
   ("save_per_pass", "Save the model after every pass over data")
+  ("background_save", "Write per pass and tagged saves from a copy-on-write snapshot while learning continues")
+  ("delta_checkpoints", "Write per pass and tagged saves as the weights changed since the previous save or -i model. Load with -i base -i delta...")
+  ("mapped_model", "Store weights page-aligned so that -t can mmap them instead of reading them")
+  ("compact_model", po::value<int>()->implicit_value(0), "Store nonzero weights with delta-coded indices, zlib-compressing blocks at the given level (1-9)")
+  ("chunked_model", "Store weights in checksummed chunks that are written and read by parallel threads")
   ("output_feature_regularizer_binary", po::value< string >(&(all.per_feature_regularizer_output)), "Per feature regularization output file")
   ("output_feature_regularizer_text", po::value< string >(&(all.per_feature_regularizer_text)), "Per feature regularization output file, in text")
   ("id", po::value< string >(&(all.id)), "User supplied ID embedded into the final regressor");
@@ -1004,12 +1161,56 @@ void parse_output_model(vw& all)
   if (vm.count("save_resume"))
     all.save_resume = true;
 
+  if (vm.count("export_predictor"))
+    all.export_predictor_name = vm["export_predictor"].as<string>();
+
+  if (vm.count("background_save"))
+    all.background_save = true;
+
+  if (vm.count("delta_checkpoints"))
+    all.delta_checkpoints = true;
+
+  // the format goes with the weights of the file written, not into its options
+  if (vm.count("mapped_model"))
+    all.mapped_model = true;
+
+  if (vm.count("compact_model"))
+  { if (all.mapped_model)
+      THROW("--compact_model and --mapped_model are incompatible");
+    all.compact_model = true;
+    all.compact_model_level = vm["compact_model"].as<int>();
+    if (all.compact_model_level < 0 || all.compact_model_level > 9)
+      THROW("--compact_model level must be between 0 and 9");
+  }
+
+  if (vm.count("chunked_model"))
+  { if (all.mapped_model || all.compact_model)
+      THROW("--chunked_model is incompatible with --mapped_model and --compact_model");
+    all.chunked_model = true;
+  }
+
   if (vm.count("id") && find(all.args.begin(), all.args.end(), "--id") == all.args.end())
   { all.args.push_back("--id");
     all.args.push_back(vm["id"].as<string>());
   }
 }
 
+// Average loss of a test-only instance over the single-line text examples of data.
+double validation_loss(vw& run, const string& data)
+{ ifstream in(data.c_str());
+  if (!in.is_open())
+    THROW("--fold_validation: can't open " << data);
+  run.sd->sum_loss = 0.;
+  run.sd->weighted_examples = 0.;
+  string line;
+  while (getline(in, line))
+  { if (line.empty())
+      continue;
+    LEARNER::process_example(run, VW::read_example(run, line));
+  }
+  return run.sd->weighted_examples > 0 ? run.sd->sum_loss / run.sd->weighted_examples : 0.;
+}
+
 void load_input_model(vw& all, io_buf& io_temp)
 { // Need to see if we have to load feature mask first or second.
   // -i and -mask are from same file, load -i file first so mask can use it
@@ -1030,6 +1231,42 @@ void load_input_model(vw& all, io_buf& io_temp)
     all.l->save_load(io_temp, true, false);
     io_temp.close_file();
   }
+
+  if (all.vm.count("initial_regressor"))
+  { vector<string> regs = all.vm["initial_regressor"].as< vector<string> >();
+    for (size_t i = 1; i < regs.size(); i++)
+      load_delta(all, regs[i]);
+
+    if (all.vm.count("fold_bits"))
+    { uint32_t model_bits = all.num_bits;
+      uint32_t bits = all.vm["fold_bits"].as<uint32_t>();
+      fold_regressor(all, bits);
+
+      if (all.vm.count("fold_validation"))
+      { // one more instance of the model, scored before and after folding its weights the same way
+        string data = all.vm["fold_validation"].as<string>();
+        std::ostringstream init_args;
+        init_args << "-t --quiet --no_stdin";
+        for (size_t i = 0; i < regs.size(); i++)
+          init_args << " -i " << regs[i];
+        vw* run = VW::initialize(init_args.str());
+        try
+        { double before = validation_loss(*run, data);
+          fold_regressor(*run, bits);
+          double after = validation_loss(*run, data);
+          cerr << "average loss on " << data << ": " << before << " with " << model_bits << " bits, "
+               << after << " folded into " << bits << endl;
+        }
+        catch (...)
+        { VW::finish(*run);
+          throw;
+        }
+        VW::finish(*run);
+      }
+    }
+    if (all.delta_checkpoints)
+      snapshot_regressor(all);
+  }
 }
 
 LEARNER::base_learner* setup_base(vw& all)
@@ -1150,11 +1387,14 @@ vw& parse_args(int argc, char *argv[])
     ("initial_regressor,i", po::value< vector<string> >(), "Initial regressor(s)")
     ("initial_weight", po::value<float>(&(all.initial_weight)), "Set all weights to an initial value of arg.")
     ("random_weights", po::value<bool>(&(all.random_weights)), "make initial weights random")
-    ("input_feature_regularizer", po::value< string >(&(all.per_feature_regularizer_input)), "Per feature regularization input file");
+    ("input_feature_regularizer", po::value< string >(&(all.per_feature_regularizer_input)), "Per feature regularization input file")
+    ("fold_bits", po::value<uint32_t>(), "Fold the -i model into 2^arg weights, as if it had been trained with -b arg")
+    ("fold_validation", po::value<string>(), "With --fold_bits, report the loss of the -i model on this file of single-line text examples before and after folding");
     add_options(all);
 
     new_options(all, "Parallelization options")
-    ("span_server", po::value<string>(), "Location of server for setting up spanning tree")
+    ("span_server", po::value<string>(), "Location of server for setting up spanning tree, host or host:port")
+    ("allreduce_timeout", po::value<size_t>()->default_value(0), "Seconds to wait for another node of the spanning tree before failing, 0 waits forever")
     ("threads", "Enable multi-threading")
     ("unique_id", po::value<size_t>()->default_value(0), "unique id used for cluster parallel jobs")
     ("total", po::value<size_t>()->default_value(1), "total number of nodes used in cluster parallel job")
@@ -1168,7 +1408,8 @@ vw& parse_args(int argc, char *argv[])
         vm["span_server"].as<string>(),
         vm["unique_id"].as<size_t>(),
         vm["total"].as<size_t>(),
-        vm["node"].as<size_t>());
+        vm["node"].as<size_t>(),
+        vm["allreduce_timeout"].as<size_t>());
     }
 
     msrand48(all.random_seed);
@@ -1402,6 +1643,73 @@ vw* seed_vw_model(vw* vw_model, const string extra_args)
   return new_model;
 }
 
+// Reductions that keep part of the model outside the weights (trees, support vectors, alphas,
+// policies, statistics cached from the weights), which only their own save_load can replace.
+const char* const stateful_reductions[] =
+{ "bfgs", "boosting", "conjugate_gradient", "ksvm", "lda", "log_multi", "multiworld_test", "recall_tree", "stage_poly" };
+
+// Re-read the -i model file(s) of a running instance and swap the new weights in.  The model is
+// loaded into a private instance first and only swapped in when it uses the same features,
+// reductions and weight layout, so a bad file leaves the running model in place.  Models of
+// reductions with state outside the weights are never swapped: they need a restart.  Weights a
+// daemon shares with its children are overwritten in place, so the children see the new model
+// without loading it themselves.
+bool reload_model(vw& all)
+{ if (!all.vm.count("initial_regressor"))
+  { cerr << "model reload: no -i model to reload" << endl;
+    return false;
+  }
+
+  vector<string> regs = all.vm["initial_regressor"].as< vector<string> >();
+  for (const char* reduction : stateful_reductions)
+    if (all.vm.count(reduction))
+    { cerr << "model reload: --" << reduction << " keeps model state outside the weights, restart to load "
+           << regs[0] << ", keeping the running model" << endl;
+      return false;
+    }
+  std::ostringstream init_args;
+  init_args << "--quiet";
+  if (!all.training)
+    init_args << " -t";
+  for (size_t i = 0; i < regs.size(); i++)
+    init_args << " -i " << regs[i];
+
+  vw* fresh;
+  uint64_t random_state = rand48_state(); // initialize seeds frand48 again
+  try
+  { fresh = VW::initialize(init_args.str());
+  }
+  catch (exception& e)
+  { msrand48(random_state);
+    cerr << "model reload: " << e.what() << endl;
+    return false;
+  }
+  msrand48(random_state);
+
+  const char* difference = are_features_compatible(all, *fresh);
+  if (difference == nullptr && fresh->reg.stride_shift != all.reg.stride_shift)
+    difference = "stride";
+  if (difference == nullptr && fresh->file_options->str() != all.file_options->str())
+    difference = "reductions";
+  if (difference != nullptr)
+  { cerr << "model reload: " << regs[0] << " is not compatible with the running model (" << difference << "), keeping it" << endl;
+    VW::finish(*fresh);
+    return false;
+  }
+
+  if (all.shared_weights)
+    memcpy(all.reg.weight_vector, fresh->reg.weight_vector, (all.length() << all.reg.stride_shift) * sizeof(weight));
+  else
+    swap(all.reg, fresh->reg);
+  all.sd->min_label = fresh->sd->min_label;
+  all.sd->max_label = fresh->sd->max_label;
+  VW::finish(*fresh); // releases the old weights, or the new ones once copied
+
+  if (!all.quiet)
+    cerr << "reloaded model from " << regs[0] << endl;
+  return true;
+}
+
 void delete_dictionary_entry(substring ss, features* A)
 { free(ss.begin);
   A->delete_v();
@@ -1481,8 +1789,13 @@ void finish(vw& all, bool delete_all)
   { all.l->finish();
     free_it(all.l);
   }
+  free(all.delta_snapshot);
   if (all.reg.weight_vector != nullptr && !all.seeded) // don't free weight vector if it is shared with another instance
-    free(all.reg.weight_vector);
+  { if (all.reg.mapped_length > 0)
+      unmap_regressor(all);
+    else
+      free(all.reg.weight_vector);
+  }
   free_parser(all);
   finalize_source(all.p);
   all.p->parse_name.erase();
@@ -1499,10 +1812,20 @@ void finish(vw& all, bool delete_all)
       io_buf::close_file_or_socket(all.final_prediction_sink[i]);
   all.final_prediction_sink.delete_v();
   for (size_t i=0; i<all.loaded_dictionaries.size(); i++)
-  { free(all.loaded_dictionaries[i].name);
-    all.loaded_dictionaries[i].dict->iter(delete_dictionary_entry);
-    all.loaded_dictionaries[i].dict->delete_v();
-    delete all.loaded_dictionaries[i].dict;
+  { dictionary_info& info = all.loaded_dictionaries[i];
+    free(info.name);
+    if (info.mapped != nullptr)
+    {
+#ifndef _WIN32
+      munmap(info.mapped->data, info.mapped->length);
+#endif
+      delete info.mapped;
+    }
+    else
+    { info.dict->iter(delete_dictionary_entry);
+      info.dict->delete_v();
+      delete info.dict;
+    }
   }
   delete all.loss;
 
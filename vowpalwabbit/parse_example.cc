@@ -37,7 +37,7 @@ public:
   bool* spelling_features;
   v_array<char> spelling;
 
-  vector<feature_dict*>* namespace_dictionaries;
+  vector<dictionary_info>* namespace_dictionaries;
 
   ~TC_parser() { }
 
@@ -166,19 +166,33 @@ public:
       }
       if (namespace_dictionaries[index].size() > 0)
       { for (size_t dict=0; dict<namespace_dictionaries[index].size(); dict++)
-        { feature_dict* map = namespace_dictionaries[index][dict];
+        { dictionary_info& info = namespace_dictionaries[index][dict];
           uint64_t hash = uniform_hash(feature_name.begin, feature_name.end-feature_name.begin, quadratic_constant);
-          features* feats = map->get(feature_name, hash);
-          if ((feats != nullptr) && (feats->values.size() > 0))
+          feature_value* values = nullptr;
+          feature_index* indicies = nullptr;
+          size_t count = 0;
+          float sum_feat_sq = 0.f;
+          if (info.mapped != nullptr)
+            info.mapped->get(feature_name, hash, values, indicies, count, sum_feat_sq);
+          else
+          { features* feats = info.dict->get(feature_name, hash);
+            if (feats != nullptr)
+            { values = feats->values.begin();
+              indicies = feats->indicies.begin();
+              count = feats->values.size();
+              sum_feat_sq = feats->sum_feat_sq;
+            }
+          }
+          if (count > 0)
             { features& dict_fs = ae->feature_space[dictionary_namespace];
               if (dict_fs.size() == 0)
                 ae->indices.push_back(dictionary_namespace);
-              push_many(dict_fs.values, feats->values.begin(), feats->values.size());
-              push_many(dict_fs.indicies, feats->indicies.begin(), feats->indicies.size());
-              dict_fs.sum_feat_sq += feats->sum_feat_sq;
+              push_many(dict_fs.values, values, count);
+              push_many(dict_fs.indicies, indicies, count);
+              dict_fs.sum_feat_sq += sum_feat_sq;
               if (audit)
-                for (size_t i = 0; i < feats->indicies.size(); ++i)
-                  { uint64_t id = feats->indicies[i];
+                for (size_t i = 0; i < count; ++i)
+                  { uint64_t id = indicies[i];
                     stringstream ss;
                     ss << index << '_';
                     for (char* fc=feature_name.begin; fc!=feature_name.end; ++fc) ss << *fc;
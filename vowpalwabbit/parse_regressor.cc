@@ -11,6 +11,8 @@ using namespace std;
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #endif
 
 #include <stdlib.h>
@@ -18,12 +20,14 @@ using namespace std;
 #include <math.h>
 #include <algorithm>
 #include <stdarg.h>
+#include <chrono>
 
 #include "rand48.h"
 #include "global_data.h"
 #include "vw_exception.h"
 #include "vw_validate.h"
 #include "vw_versions.h"
+#include "cache.h"
 
 void initialize_regressor(vw& all)
 { // Regressor is already initialized.
@@ -52,6 +56,40 @@ void initialize_regressor(vw& all)
       all.reg.weight_vector[j << all.reg.stride_shift] = (float)(frand48() - 0.5);
 }
 
+void unmap_regressor(vw& all)
+{
+#ifndef _WIN32
+  munmap(all.reg.weight_vector, all.reg.mapped_length);
+#endif
+  all.reg.weight_vector = nullptr;
+  all.reg.mapped_length = 0;
+}
+
+// Replace the weight vector with a copy-on-write mapping of length bytes of fd starting at offset.
+// Pages stay shared with the file until written: some reductions (nn for one) write weights even
+// when only predicting, and those writes go to private copies, never to the file.
+// Returns false when the weights can't be mapped, in which case they must be read instead.
+bool map_regressor(vw& all, int fd, uint64_t offset, size_t length)
+{
+#ifdef _WIN32
+  return false;
+#else
+  if (offset % (uint64_t)sysconf(_SC_PAGESIZE) != 0)
+    return false;
+  void* weights = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)offset);
+  if (weights == MAP_FAILED)
+    return false;
+
+  if (all.reg.mapped_length > 0)
+    unmap_regressor(all);
+  else
+    free(all.reg.weight_vector);
+  all.reg.weight_vector = (weight*)weights;
+  all.reg.mapped_length = length;
+  return true;
+#endif
+}
+
 const size_t default_buf_size = 512;
 
 bool resize_buf_if_needed(char *& __dest, size_t& __dest_size, const size_t __n)
@@ -424,20 +462,231 @@ void dump_regressor(vw& all, string reg_name, bool as_text)
   rename(start_name.c_str(),reg_name.c_str());
 }
 
+void wait_for_background_save(vw& all)
+{
+#ifndef _WIN32
+  if (all.background_save_pid == 0)
+    return;
+  int status = 0;
+  if (waitpid(all.background_save_pid, &status, 0) != all.background_save_pid
+      || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    cerr << "warning: background save of the regressor failed" << endl;
+  all.background_save_pid = 0;
+#endif
+}
+
+// The forked child sees a copy-on-write snapshot of the model, so learning only waits for the fork
+// and for a previous checkpoint that is still being written.  Saves are written one at a time so
+// that an older checkpoint can't be renamed over a newer one.
+void background_dump_regressor(vw& all, string reg_name)
+{ wait_for_background_save(all);
+#ifndef _WIN32
+  cerr.flush();
+  pid_t pid = fork();
+  if (pid == 0)
+  { int ret = 0;
+    try
+    { dump_regressor(all, reg_name, false);
+    }
+    catch (exception& e)
+    { cerr << "vw background save: " << e.what() << endl;
+      ret = 1;
+    }
+    _exit(ret);
+  }
+  if (pid > 0)
+  { all.background_save_pid = pid;
+    return;
+  }
+  cerr << "warning: can't fork for a background save, saving in the foreground: " << strerror(errno) << endl;
+#endif
+  dump_regressor(all, reg_name, false);
+}
+
+// A delta checkpoint holds the weights, with their whole stride, that changed since the model it
+// applies to.  That parent is named by a hash of its weights, so a delta only loads on top of the
+// exact weights it was taken against: its base model and the deltas before it, in order.
+const char delta_magic[] = "vw delta";
+const uint32_t max_delta_stride_shift = 8;
+
+// Hash of the first float of each weight, the part every model file carries whatever the stride
+// of the run that saved or loaded it.
+uint32_t weights_checksum(vw& all, weight* weights)
+{ uint64_t length = (uint64_t)1 << all.num_bits;
+  weight chunk[1024];
+  uint64_t hash = 0;
+  for (uint64_t i = 0; i < length;)
+  { size_t n = 0;
+    for (; n < 1024 && i < length; n++, i++)
+      chunk[n] = weights[i << all.reg.stride_shift];
+    hash = uniform_hash(chunk, n * sizeof(weight), hash);
+  }
+  return (uint32_t)hash;
+}
+
+void snapshot_regressor(vw& all)
+{ size_t length = ((size_t)1 << all.num_bits) << all.reg.stride_shift;
+  if (all.delta_snapshot == nullptr)
+    all.delta_snapshot = calloc_or_throw<weight>(length);
+  memcpy(all.delta_snapshot, all.reg.weight_vector, length * sizeof(weight));
+}
+
+void dump_delta(vw& all, string reg_name)
+{ uint64_t length = (uint64_t)1 << all.num_bits;
+  uint32_t stride_shift = all.reg.stride_shift;
+  size_t stride_bytes = sizeof(weight) << stride_shift;
+  weight* weights = all.reg.weight_vector;
+
+  v_array<uint64_t> changed = v_init<uint64_t>();
+  for (uint64_t i = 0; i < length; i++)
+    if (memcmp(weights + (i << stride_shift), all.delta_snapshot + (i << stride_shift), stride_bytes) != 0)
+      changed.push_back(i);
+
+  string start_name = reg_name + string(".writing");
+  io_buf io_temp;
+  io_temp.open_file(start_name.c_str(), all.stdin_off, io_buf::WRITE);
+  io_temp.verify_hash = true;
+  io_temp.hash = 0;
+
+  uint32_t parent = weights_checksum(all, all.delta_snapshot);
+  uint32_t num_bits = all.num_bits;
+  uint64_t count = changed.size();
+  bin_write_fixed(io_temp, delta_magic, sizeof(delta_magic) - 1);
+  bin_write_fixed(io_temp, (char*)&parent, sizeof(parent));
+  bin_write_fixed(io_temp, (char*)&num_bits, sizeof(num_bits));
+  bin_write_fixed(io_temp, (char*)&stride_shift, sizeof(stride_shift));
+  bin_write_fixed(io_temp, (char*)&count, sizeof(count));
+
+  uint64_t next = 0;
+  for (size_t j = 0; j < changed.size(); j++)
+  { uint64_t i = changed[j];
+    char gap[10];
+    char* end = run_len_encode(gap, i - next);
+    bin_write_fixed(io_temp, gap, (uint32_t)(end - gap));
+    bin_write_fixed(io_temp, (char*)(weights + (i << stride_shift)), (uint32_t)stride_bytes);
+    next = i + 1;
+  }
+
+  io_temp.verify_hash = false;
+  uint32_t check_sum = io_temp.hash;
+  bin_write_fixed(io_temp, (char*)&check_sum, sizeof(check_sum));
+  io_temp.flush();
+  io_temp.close_file();
+
+  remove(reg_name.c_str());
+  rename(start_name.c_str(), reg_name.c_str());
+
+  if (!all.quiet)
+    cerr << "saved delta " << reg_name << ": " << changed.size() << " of " << length << " weights changed" << endl;
+  changed.delete_v();
+}
+
+void load_delta(vw& all, string delta_name)
+{ io_buf io_temp;
+  io_temp.open_file(delta_name.c_str(), all.stdin_off, io_buf::READ);
+  io_temp.verify_hash = true;
+  io_temp.hash = 0;
+
+  char magic[sizeof(delta_magic) - 1];
+  memcpy(magic, delta_magic, sizeof(magic));
+  uint32_t parent = 0;
+  uint32_t num_bits = 0;
+  uint32_t stride_shift = 0;
+  uint64_t count = 0;
+  if (bin_read_fixed(io_temp, magic, sizeof(magic), "file is not a delta checkpoint") < sizeof(magic)
+      || bin_read_fixed(io_temp, (char*)&parent, sizeof(parent), "") < sizeof(parent)
+      || bin_read_fixed(io_temp, (char*)&num_bits, sizeof(num_bits), "") < sizeof(num_bits)
+      || bin_read_fixed(io_temp, (char*)&stride_shift, sizeof(stride_shift), "") < sizeof(stride_shift)
+      || bin_read_fixed(io_temp, (char*)&count, sizeof(count), "") < sizeof(count))
+    THROW("Unexpected end of file encountered in " << delta_name);
+  if (num_bits != all.num_bits)
+    THROW(delta_name << " has " << num_bits << " bits but the model has " << all.num_bits);
+  if (parent != weights_checksum(all, all.reg.weight_vector))
+    THROW(delta_name << " doesn't apply to the model loaded so far: give -i the base model and then its deltas in the order they were saved");
+  if (stride_shift > max_delta_stride_shift)
+    THROW("Model content is corrupted, bad weight stride in " << delta_name);
+
+
+  uint64_t length = (uint64_t)1 << all.num_bits;
+  size_t record = sizeof(weight) << stride_shift;
+  size_t copy = sizeof(weight) << min(stride_shift, all.reg.stride_shift);
+  weight floats[1 << max_delta_stride_shift];
+  uint64_t next = 0;
+  for (uint64_t n = 0; n < count; n++)
+  { // the gap is hashed as one piece, the way it was written
+    char gap_bytes[10];
+    size_t gap_len = 0;
+    io_temp.verify_hash = false;
+    do
+    { if (gap_len == sizeof(gap_bytes) || bin_read_fixed(io_temp, gap_bytes + gap_len, 1, "") < 1)
+        THROW("Unexpected end of file encountered in " << delta_name);
+    }
+    while (gap_bytes[gap_len++] & 128);
+    io_temp.verify_hash = true;
+    io_temp.hash = (uint32_t)uniform_hash(gap_bytes, gap_len, io_temp.hash);
+    uint64_t gap = 0;
+    run_len_decode(gap_bytes, gap);
+
+    uint64_t i = next + gap;
+    if (i >= length)
+      THROW("Model content is corrupted, weight vector index " << i << " must be less than total vector length " << length);
+    if (bin_read_fixed(io_temp, (char*)floats, record, "") < record)
+      THROW("Unexpected end of file encountered in " << delta_name);
+    memcpy(all.reg.weight_vector + (i << all.reg.stride_shift), floats, copy);
+    next = i + 1;
+  }
+
+  io_temp.verify_hash = false;
+  uint32_t check_sum_saved = io_temp.hash;
+  uint32_t check_sum = 0;
+  bin_read_fixed(io_temp, (char*)&check_sum, sizeof(check_sum), "");
+  if (check_sum_saved != check_sum)
+    THROW("Checksum is inconsistent, " << delta_name << " is possibly corrupted.");
+  io_temp.close_file();
+
+  if (!all.quiet)
+    cerr << "applied delta " << delta_name << ": " << count << " weights" << endl;
+}
+
 void save_predictor(vw& all, string reg_name, size_t current_pass)
 { stringstream filename;
   filename << reg_name;
   if (all.save_per_pass)
     filename << "." << current_pass;
-  dump_regressor(all, filename.str(), false);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (all.delta_checkpoints && all.delta_snapshot != nullptr)
+    dump_delta(all, filename.str()); // in the foreground: the next delta is taken against this one
+  else if (all.background_save && !all.delta_checkpoints)
+    background_dump_regressor(all, filename.str());
+  else
+    dump_regressor(all, filename.str(), false);
+  if (all.delta_checkpoints)
+    snapshot_regressor(all);
+  all.checkpoint_stall += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  all.checkpoints++;
 }
 
 void finalize_regressor(vw& all, string reg_name)
-{ if (!all.early_terminate)
+{ wait_for_background_save(all);
+  if (all.background_save && !all.quiet && all.checkpoints > 0)
+  { cerr << "learning stalled " << all.checkpoint_stall << " seconds for "
+         << all.checkpoints << " background saves" << endl;
+    all.checkpoints = 0;
+  }
+
+  if (!all.early_terminate)
   { if (all.per_feature_regularizer_output.length() > 0)
       dump_regressor(all, all.per_feature_regularizer_output, false);
     else
       dump_regressor(all, reg_name, false);
+    if (all.export_predictor_name.length() > 0)
+    { // only the weights: no per-weight optimizer state, which stores up to four floats per weight
+      bool resume = all.save_resume;
+      all.save_resume = false;
+      dump_regressor(all, all.export_predictor_name, false);
+      all.save_resume = resume;
+    }
     if (all.per_feature_regularizer_text.length() > 0)
       dump_regressor(all, all.per_feature_regularizer_text, true);
     else
@@ -449,6 +698,48 @@ void finalize_regressor(vw& all, string reg_name)
   }
 }
 
+// Shrink the weights to 2^bits by adding up those whose indices agree in their low bits.  Feature
+// indices are the low bits of the feature hashes, so this is the table a run with -b bits would
+// index, and feature names are not needed; only the weights of colliding features get mixed.  The
+// --save_resume state of colliding weights is added up as well.
+void fold_regressor(vw& all, uint32_t bits)
+{ if (all.reg.weight_vector == nullptr)
+    THROW("--fold_bits needs a model kept in weights, this one has none");
+  if (bits == 0 || bits >= all.num_bits)
+    THROW("--fold_bits " << bits << " must be between 1 and the model's " << all.num_bits - 1 << " bits");
+
+  uint64_t length = (uint64_t)1 << all.num_bits;
+  uint64_t folded_length = (uint64_t)1 << bits;
+  uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
+  weight* folded = calloc_mergable_or_throw<weight>(folded_length << all.reg.stride_shift);
+  uint64_t nonzero = 0;
+  uint64_t collided = 0; // nonzero weights added to an occupied slot
+  for (uint64_t i = 0; i < length; i++)
+  { weight* w = all.reg.weight_vector + (i << all.reg.stride_shift);
+    if (*w == 0.)
+      continue;
+    weight* f = folded + ((i & (folded_length - 1)) << all.reg.stride_shift);
+    nonzero++;
+    if (*f != 0.)
+      collided++;
+    for (uint64_t k = 0; k < stride; k++)
+      f[k] += w[k];
+  }
+
+  if (all.reg.mapped_length > 0)
+    unmap_regressor(all);
+  else
+    free(all.reg.weight_vector);
+  all.reg.weight_vector = folded;
+  all.reg.weight_mask = (folded_length << all.reg.stride_shift) - 1;
+  uint32_t model_bits = all.num_bits;
+  all.num_bits = bits;
+
+  if (!all.quiet)
+    cerr << "folded " << model_bits << " bits into " << bits << ": " << nonzero << " nonzero weights, "
+         << collided << " collided (" << (nonzero > 0 ? 100. * collided / nonzero : 0.) << "%)" << endl;
+}
+
 void parse_regressor_args(vw& all, io_buf& io_temp)
 { po::variables_map& vm = all.vm;
   vector<string> regs;
@@ -459,13 +750,10 @@ void parse_regressor_args(vw& all, io_buf& io_temp)
     regs.push_back(vm["input_feature_regularizer"].as<string>());
 
   if (regs.size() > 0)
-  { io_temp.open_file(regs[0].c_str(), all.stdin_off, io_buf::READ);
-    if (!all.quiet)
-    { //cerr << "initial_regressor = " << regs[0] << endl;
-      if (regs.size() > 1)
-      { cerr << "warning: ignoring remaining " << (regs.size() - 1) << " initial regressors" << endl;
-      }
-    }
+  { // any further -i are delta checkpoints, applied by load_delta once the model is loaded
+    io_temp.open_file(regs[0].c_str(), all.stdin_off, io_buf::READ);
+    if (!all.quiet && vm.count("initial_regressor") && vm.count("input_feature_regularizer"))
+      cerr << "warning: ignoring input_feature_regularizer" << endl;
   }
 }
 
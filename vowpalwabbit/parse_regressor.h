@@ -16,8 +16,13 @@ void parse_regressor_args(vw& all, io_buf& io_temp);
 
 void finalize_regressor(vw& all, std::string reg_name);
 void initialize_regressor(vw& all);
+bool map_regressor(vw& all, int fd, uint64_t offset, size_t length);
+void unmap_regressor(vw& all);
+void fold_regressor(vw& all, uint32_t bits);
 
 void save_predictor(vw& all, std::string reg_name, size_t current_pass);
+void snapshot_regressor(vw& all);
+void load_delta(vw& all, std::string delta_name);
 void save_load_header(vw& all, io_buf& model_file, bool read, bool text);
 
 void parse_mask_regressor_args(vw& all);
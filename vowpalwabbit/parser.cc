@@ -131,6 +131,32 @@ void handle_sigterm (int)
 { got_sigterm = true;
 }
 
+// SIGHUP asks a daemon to reload its model.  The learner picks the request up between examples.
+volatile sig_atomic_t got_sighup;
+
+void handle_sighup (int)
+{ got_sighup = true;
+}
+
+bool model_reload_requested()
+{ if (!got_sighup)
+    return false;
+  got_sighup = false;
+  return true;
+}
+
+#ifndef _WIN32
+// Children restart interrupted reads and accepts, the parent wants its wait() interrupted.
+void install_sighup_handler(bool restart)
+{ struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_sighup;
+  if (restart)
+    sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, nullptr);
+}
+#endif
+
 bool is_test_only(uint32_t counter, uint32_t period, uint32_t after, bool holdout_off, uint32_t target_modulus)  // target should be 0 in the normal case, or period-1 in the case that emptylines separate examples
 { if(holdout_off) return false;
   if (after == 0) // hold out by period
@@ -451,16 +477,22 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       THROW("not supported on windows");
 #else
       fclose(stdin);
-      // weights will be shared across processes, accessible to children
-      float* shared_weights =
-        (float*)mmap(0,(all.length() << all.reg.stride_shift) * sizeof(float),
-                     PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-
-      size_t float_count = all.length() << all.reg.stride_shift;
-      weight* dest = shared_weights;
-      memcpy(dest, all.reg.weight_vector, float_count*sizeof(float));
-      free(all.reg.weight_vector);
-      all.reg.weight_vector = dest;
+      // weights will be shared across processes, accessible to children.
+      // Weights mapped from a --mapped_model file are shared already, apart from pages written,
+      // and reductions like ksvm keep no weights at all.
+      if (all.reg.mapped_length == 0 && all.reg.weight_vector != nullptr)
+      { float* shared_weights =
+          (float*)mmap(0,(all.length() << all.reg.stride_shift) * sizeof(float),
+                       PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+
+        size_t float_count = all.length() << all.reg.stride_shift;
+        weight* dest = shared_weights;
+        memcpy(dest, all.reg.weight_vector, float_count*sizeof(float));
+        free(all.reg.weight_vector);
+        all.reg.weight_vector = dest;
+        all.reg.mapped_length = float_count*sizeof(float);
+        all.shared_weights = true;
+      }
 
       // learning state to be shared across children
       shared_data* sd = (shared_data *)mmap(0,sizeof(shared_data),
@@ -469,6 +501,8 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       free(all.sd);
       all.sd = sd;
 
+      install_sighup_handler(true);
+
       // create children
       size_t num_children = all.num_children;
       v_array<int> children = v_init<int>();
@@ -490,6 +524,7 @@ void enable_sources(vw& all, bool quiet, size_t passes)
         sa.sa_handler = handle_sigterm;
         sigaction(SIGTERM, &sa, nullptr);
       }
+      install_sighup_handler(false);
 
       while (true)
       { // wait for child to change state; if finished, then respawn
@@ -501,12 +536,21 @@ void enable_sources(vw& all, bool quiet, size_t passes)
           VW::finish(all);
           exit(0);
         }
+        if (model_reload_requested())
+        { // Shared weights are reloaded once, here, into the memory the children use.  Weights
+          // mapped from a --mapped_model file are private to each process, so the children map
+          // the new file too, which costs them no copy of it.
+          if (VW::reload_model(all) && !all.shared_weights)
+            for (size_t i = 0; i < num_children; i++)
+              kill(children[i], SIGHUP);
+        }
         if (pid < 0)
           continue;
         for (size_t i = 0; i < num_children; i++)
           if (pid == children[i])
           { if ((children[i]=fork()) == 0)
             { all.quiet |= (i > 0);
+              install_sighup_handler(true);
               goto child;
             }
             break;
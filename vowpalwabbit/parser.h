@@ -61,6 +61,7 @@ parser* new_parser();
 void enable_sources(vw& all, bool quiet, size_t passes);
 
 bool examples_to_finish();
+bool model_reload_requested();
 
 //only call these from the library form:
 void initialize_parser_datastructures(vw& all);
@@ -68,6 +69,7 @@ void release_parser_datastructures(vw& all);
 void adjust_used_index(vw& all);
 
 //parser control
+example* get_unused_example(vw& all);
 void make_example_available();
 void set_done(vw& all);
 
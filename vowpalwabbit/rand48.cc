@@ -22,13 +22,20 @@ float merand48(uint64_t& initial) {
 
 uint64_t v = c;
 
-void msrand48(uint64_t initial) { v = initial; }
+// Threads draw from the shared state v unless they were given one of their own.
+thread_local uint64_t* state = &v;
 
-float frand48() { return merand48(v); }
+void use_rand48_state(uint64_t* own) { state = own ? own : &v; }
+
+uint64_t rand48_state() { return *state; }
+
+void msrand48(uint64_t initial) { *state = initial; }
+
+float frand48() { return merand48(*state); }
 
 float frand48_noadvance()
-{ uint64_t old_v = v;
+{ uint64_t old_v = *state;
   float ret = frand48();
-  v = old_v;
+  *state = old_v;
   return ret;
 }
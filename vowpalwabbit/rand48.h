@@ -3,4 +3,8 @@ void msrand48(uint64_t initial);
 float merand48(uint64_t& initial);
 float frand48();
 float frand48_noadvance();
+// Makes msrand48 and frand48 on the calling thread use *own instead of the state shared by all
+// threads, or the shared state again when own is nullptr.
+void use_rand48_state(uint64_t* own);
+uint64_t rand48_state();
 
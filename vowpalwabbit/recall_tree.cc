@@ -8,6 +8,7 @@ license as described in the file LICENSE.node
 #include <cstdio>
 #include <float.h>
 #include <sstream>
+#include <vector>
 
 #include "reductions.h"
 #include "rand48.h"
@@ -55,6 +56,20 @@ struct node {
     }
 };
 
+// The tree as a test-only predict walks it, packed breadth-first so the top levels share cache
+// lines, with everything a prediction reads about a node inlined: its router, where each score sends
+// it (the stopping rule already applied), its node id features and its candidates.
+struct flat_node {
+  bool internal;
+  uint32_t base_router;
+  uint32_t next[2]; // for a negative and a positive router score; the node itself where recall stops improving
+
+  uint32_t id_begin; // ids of the nodes whose features add_node_id_feature adds, in flat_ids
+  uint32_t id_end;
+  uint32_t candidate_begin; // candidate labels in flat_candidates
+  uint32_t candidate_end;
+};
+
 struct recall_tree {
   vw* all;
   uint32_t k;
@@ -62,6 +77,10 @@ struct recall_tree {
 
   v_array<node> nodes;
 
+  v_array<flat_node> flat; // built from nodes when not training
+  v_array<uint32_t> flat_ids;
+  v_array<uint32_t> flat_candidates;
+
   size_t max_candidates;
   size_t max_routers;
   size_t max_depth;
@@ -347,8 +366,116 @@ predict_type predict_from (recall_tree& b,
   return predict_type (cn, oas_predict (b, base, cn, ec));
 }
 
+void compile_tree (recall_tree& b)
+{
+  b.flat.erase ();
+  b.flat_ids.erase ();
+  b.flat_candidates.erase ();
+
+  vector<uint32_t> order (1, 0);
+  vector<uint32_t> position (b.nodes.size ());
+  for (size_t i = 0; i < order.size (); ++i)
+    {
+      position[order[i]] = (uint32_t) i;
+      if (b.nodes[order[i]].internal)
+        {
+          order.push_back (b.nodes[order[i]].left);
+          order.push_back (b.nodes[order[i]].right);
+        }
+    }
+
+  for (size_t i = 0; i < order.size (); ++i)
+    {
+      uint32_t cn = order[i];
+      node& n = b.nodes[cn];
+      flat_node f;
+
+      f.internal = n.internal;
+      f.base_router = n.base_router;
+      f.next[0] = f.next[1] = (uint32_t) i;
+      if (n.internal)
+        {
+          if (! stop_recurse_check (b, cn, n.left))
+            f.next[0] = position[n.left];
+          if (! stop_recurse_check (b, cn, n.right))
+            f.next[1] = position[n.right];
+        }
+
+      f.id_begin = (uint32_t) b.flat_ids.size ();
+      if (b.node_only)
+        b.flat_ids.push_back (cn);
+      else
+        for (uint32_t id = cn; id > 0; id = b.nodes[id].parent)
+          b.flat_ids.push_back (id);
+      f.id_end = (uint32_t) b.flat_ids.size ();
+
+      f.candidate_begin = (uint32_t) b.flat_candidates.size ();
+      for (size_t j = 0; j < n.preds.size () && j < b.max_candidates; ++j)
+        b.flat_candidates.push_back (n.preds[j].label);
+      f.candidate_end = (uint32_t) b.flat_candidates.size ();
+
+      b.flat.push_back (f);
+    }
+}
+
+// predict_from (b, base, ec, 0) on the flattened tree
+uint32_t predict_flat (recall_tree& b, base_learner& base, example& ec)
+{
+  MULTICLASS::label_t mc = ec.l.multi;
+
+  ec.l.simple = {FLT_MAX, 0.f, 0.f};
+  uint32_t cn = 0;
+  while (b.flat[cn].internal)
+    {
+      base.predict (ec, b.flat[cn].base_router);
+      uint32_t newcn = b.flat[cn].next[ec.partial_prediction < 0 ? 0 : 1];
+
+      if (newcn == cn)
+        break;
+
+      cn = newcn;
+    }
+
+  // the weights are not there yet when the tree is compiled at load, so the ids are hashed here
+  uint64_t mask = b.all->reg.weight_mask;
+  size_t ss = b.all->reg.stride_shift;
+  flat_node& f = b.flat[cn];
+  ec.indices.push_back (node_id_namespace);
+  features& fs = ec.feature_space[node_id_namespace];
+  for (uint32_t* id = b.flat_ids.begin () + f.id_begin; id != b.flat_ids.begin () + f.id_end; ++id)
+    fs.push_back (1., ((868771 * *id) << ss) & mask);
+
+  uint32_t amaxscore = 0;
+  float maxscore = std::numeric_limits<float>::lowest ();
+  for (uint32_t* label = b.flat_candidates.begin () + f.candidate_begin;
+       label != b.flat_candidates.begin () + f.candidate_end;
+       ++label)
+    {
+      base.predict (ec, b.max_routers + *label - 1);
+      if (amaxscore == 0 || ec.partial_prediction > maxscore)
+        {
+          maxscore = ec.partial_prediction;
+          amaxscore = *label;
+        }
+    }
+
+  remove_node_id_feature (b, cn, ec);
+
+  ec.l.multi = mc;
+
+  return amaxscore;
+}
+
 void predict (recall_tree& b,  base_learner& base, example& ec)
 {
+  if (! b.all->training)
+    {
+      if (b.flat.size () == 0)
+        compile_tree (b);
+      ec.pred.multiclass = predict_flat (b, base, ec);
+      return;
+    }
+
   predict_type pred = predict_from (b, base, ec, 0);
 
   ec.pred.multiclass = pred.class_prediction;
@@ -457,6 +584,9 @@ void finish (recall_tree& b)
   for (size_t i = 0; i < b.nodes.size (); ++i)
     b.nodes[i].preds.delete_v ();
   b.nodes.delete_v ();
+  b.flat.delete_v ();
+  b.flat_ids.delete_v ();
+  b.flat_candidates.delete_v ();
 }
 
 #define writeit(what,str)                               \
@@ -550,6 +680,9 @@ void save_load_tree(recall_tree& b, io_buf& model_file, bool read, bool text)
               compute_recall_lbest (b, cn);
             }
         }
+
+      if (read && ! b.all->training)
+        compile_tree (b);
     }
 }
 
@@ -82,6 +82,7 @@ LEARNER::base_learner* scorer_setup(vw& all)
   l->set_multipredict(multipredict_f);
   l->set_update(update);
   all.scorer = make_base(*l);
+  all.linear_scorer = base == all.linear_learner;
 
   return all.scorer;
 }
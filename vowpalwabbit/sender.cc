@@ -1,4 +1,8 @@
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #ifdef _WIN32
 #include <WinSock2.h>
 #ifndef SHUT_RD
@@ -20,6 +24,9 @@
 #include "network.h"
 #include "reductions.h"
 
+using namespace std;
+typedef chrono::steady_clock sender_clock;
+
 struct sender
 { io_buf* buf;
   int sd;
@@ -27,6 +34,26 @@ struct sender
   example** delay_ring;
   size_t sent_index;
   size_t received_index;
+
+  // pipelined mode: examples are written in batches and results are collected by a separate thread.
+  bool pipelined;
+  size_t batch_size; // examples per network write
+  size_t window; // maximum examples sent but not yet finished
+  size_t flushed_index; // examples actually written to the socket
+  size_t finished_index; // examples handed back to the parser
+  bool sending_done;
+  bool receive_failed;
+  string* receive_error;
+  thread* receiver;
+  mutex* lock;
+  condition_variable* cv;
+
+  // statistics, reported at end_examples
+  sender_clock::time_point* send_time; // per ring slot, stamped when the batch is written
+  sender_clock::time_point start_time;
+  double rtt_sum; // seconds
+  double rtt_max;
+  size_t batches;
 };
 
 void open_sockets(sender& s, string host)
@@ -44,7 +71,6 @@ void send_features(io_buf *b, example& ec, uint32_t mask)
       continue;
     output_features(*b, ns, ec.feature_space[ns], mask);
   }
-  b->flush();
 }
 
 void receive_result(sender& s)
@@ -60,14 +86,106 @@ void receive_result(sender& s)
   return_simple_example(*(s.all), nullptr, ec);
 }
 
+void receive_loop(sender* ps)
+{ sender& s = *ps;
+  size_t ring_size = s.all->p->ring_size;
+  try
+  { while (true)
+    { { unique_lock<mutex> l(*s.lock);
+        s.cv->wait(l, [&s] { return s.received_index < s.flushed_index || s.sending_done; });
+        if (s.received_index == s.flushed_index)
+          return;
+      }
+
+      float res, weight;
+      get_prediction(s.sd, res, weight);
+      size_t slot = s.received_index % ring_size;
+      s.delay_ring[slot]->pred.scalar = res;
+      double rtt = chrono::duration<double>(sender_clock::now() - s.send_time[slot]).count();
+      s.rtt_sum += rtt;
+      s.rtt_max = max(s.rtt_max, rtt);
+
+      unique_lock<mutex> l(*s.lock);
+      s.received_index++;
+      s.cv->notify_all();
+    }
+  }
+  catch (exception& e)
+  { unique_lock<mutex> l(*s.lock);
+    s.receive_failed = true;
+    *s.receive_error = e.what();
+    s.cv->notify_all();
+  }
+}
+
+void flush_batch(sender& s)
+{ if (s.flushed_index == s.sent_index)
+    return;
+  s.buf->flush();
+  s.batches++;
+  sender_clock::time_point now = sender_clock::now();
+  for (size_t i = s.flushed_index; i < s.sent_index; i++)
+    s.send_time[i % s.all->p->ring_size] = now;
+
+  unique_lock<mutex> l(*s.lock);
+  s.flushed_index = s.sent_index;
+  s.cv->notify_all();
+}
+
+// Hand back every example whose result has arrived.  When block is set, first wait until at
+// least one more result is available.
+void finish_received(sender& s, bool block)
+{ size_t received;
+  { unique_lock<mutex> l(*s.lock);
+    if (block)
+      s.cv->wait(l, [&s] { return s.received_index > s.finished_index || s.receive_failed; });
+    if (s.receive_failed)
+      THROW("sendto: failed to receive result: " << *s.receive_error);
+    received = s.received_index;
+  }
+
+  while (s.finished_index < received)
+  { example& ec = *s.delay_ring[s.finished_index++ % s.all->p->ring_size];
+    label_data& ld = ec.l.simple;
+    ec.loss = s.all->loss->getLoss(s.all->sd, ec.pred.scalar, ld.label) * ec.weight;
+    return_simple_example(*(s.all), nullptr, ec);
+  }
+}
+
+void learn_pipelined(sender& s, example& ec)
+{ if (s.sent_index == 0)
+    s.start_time = sender_clock::now();
+
+  finish_received(s, false);
+  while (s.sent_index - s.finished_index >= s.window)
+  { flush_batch(s);
+    finish_received(s, true);
+  }
+
+  s.all->set_minmax(s.all->sd, ec.l.simple.label);
+  s.all->p->lp.cache_label(&ec.l, *s.buf);//send label information.
+  cache_tag(*s.buf, ec.tag);
+  send_features(s.buf,ec, (uint32_t)s.all->parse_mask);
+  s.delay_ring[s.sent_index++ % s.all->p->ring_size] = &ec;
+
+  if (s.sent_index - s.flushed_index >= s.batch_size)
+    flush_batch(s);
+}
+
 void learn(sender& s, LEARNER::base_learner&, example& ec)
-{ if (s.received_index + s.all->p->ring_size / 2 - 1 == s.sent_index)
+{ if (s.pipelined)
+  { learn_pipelined(s, ec);
+    return;
+  }
+
+  if (s.received_index + s.all->p->ring_size / 2 - 1 == s.sent_index)
     receive_result(s);
 
   s.all->set_minmax(s.all->sd, ec.l.simple.label);
   s.all->p->lp.cache_label(&ec.l, *s.buf);//send label information.
   cache_tag(*s.buf, ec.tag);
   send_features(s.buf,ec, (uint32_t)s.all->parse_mask);
+  s.buf->flush();
   s.delay_ring[s.sent_index++ % s.all->p->ring_size] = &ec;
 }
 
@@ -75,13 +193,49 @@ void finish_example(vw&, sender&, example&) {}
 
 void end_examples(sender& s)
 { //close our outputs to signal finishing.
-  while (s.received_index != s.sent_index)
-    receive_result(s);
+  if (s.pipelined)
+  { flush_batch(s);
+    while (s.finished_index != s.sent_index)
+      finish_received(s, true);
+    { unique_lock<mutex> l(*s.lock);
+      s.sending_done = true;
+      s.cv->notify_all();
+    }
+    s.receiver->join();
+
+    if (!s.all->quiet && s.sent_index > 0)
+    { double elapsed = chrono::duration<double>(sender_clock::now() - s.start_time).count();
+      cerr << "sendto: " << s.sent_index << " examples in " << s.batches << " batches, "
+           << (elapsed > 0. ? s.sent_index / elapsed : 0.) << " examples/sec" << endl;
+      cerr << "sendto: round trip latency mean " << 1000. * s.rtt_sum / s.sent_index
+           << " ms, max " << 1000. * s.rtt_max << " ms" << endl;
+    }
+  }
+  else
+    while (s.received_index != s.sent_index)
+      receive_result(s);
   shutdown(s.buf->files[0],SHUT_WR);
 }
 
 void finish(sender& s)
-{ s.buf->files.delete_v();
+{ // the receiver reads the ring and the socket: stop it before freeing either
+  if (s.pipelined)
+  { if (s.receiver->joinable())
+    { // learning was aborted: unblock the receiver if it is waiting on the socket
+      shutdown(s.sd, SHUT_RDWR);
+      { unique_lock<mutex> l(*s.lock);
+        s.sending_done = true;
+        s.cv->notify_all();
+      }
+      s.receiver->join();
+    }
+    delete s.receiver;
+    delete s.lock;
+    delete s.cv;
+    free(s.send_time);
+    delete s.receive_error;
+  }
+  s.buf->files.delete_v();
   s.buf->space.delete_v();
   free(s.delay_ring);
   delete s.buf;
@@ -90,6 +244,10 @@ void finish(sender& s)
 LEARNER::base_learner* sender_setup(vw& all)
 { if (missing_option<string, true>(all, "sendto", "send examples to <host>"))
     return nullptr;
+  new_options(all, "Sendto options")
+  ("sendto_batch", po::value<size_t>(), "pipeline sending: number of examples per network write")
+  ("sendto_window", po::value<size_t>(), "pipeline sending: maximum number of examples awaiting a result");
+  add_options(all);
 
   sender& s = calloc_or_throw<sender>();
   s.sd = -1;
@@ -101,6 +259,24 @@ LEARNER::base_learner* sender_setup(vw& all)
   s.all = &all;
   s.delay_ring = calloc_or_throw<example*>(all.p->ring_size);
 
+  s.pipelined = all.vm.count("sendto_batch") || all.vm.count("sendto_window");
+  if (s.pipelined)
+  { size_t max_window = all.p->ring_size / 2;
+    s.window = all.vm.count("sendto_window") ? all.vm["sendto_window"].as<size_t>() : max_window;
+    if (s.window == 0 || s.window > max_window)
+      THROW("--sendto_window must be between 1 and half of --ring_size (" << max_window << ")");
+    s.batch_size = all.vm.count("sendto_batch") ? all.vm["sendto_batch"].as<size_t>() : 16;
+    if (s.batch_size == 0)
+      THROW("--sendto_batch must be positive");
+    s.batch_size = min(s.batch_size, s.window);
+
+    s.receive_error = new string();
+    s.send_time = calloc_or_throw<sender_clock::time_point>(all.p->ring_size);
+    s.lock = new mutex;
+    s.cv = new condition_variable;
+    s.receiver = new thread(receive_loop, &s);
+  }
+
   LEARNER::learner<sender>& l = init_learner(&s, learn, 1);
   l.set_finish(finish);
   l.set_finish_example(finish_example);
@@ -0,0 +1,370 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#ifdef _WIN32
+#include <WinSock2.h>
+#define poll WSAPoll
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include "serve.h"
+#include "vw.h"
+#include "learner.h"
+#include "rand48.h"
+#include "vw_exception.h"
+
+using namespace std;
+
+namespace VW
+{
+struct served_model
+{ string id;
+  vw* all; // all->random_state is its frand48 state, whichever thread predicts
+  mutex lock; // one request at a time per model
+  size_t requests;
+  double total_us;
+  double max_us;
+};
+
+struct connection
+{ int fd;
+  string pending; // received text after the last complete line
+};
+
+// The accepting thread polls every idle connection and hands a readable one to the pool.  A
+// handler answers the lines that arrived and gives the connection back through the wake pipe, so
+// a connection is with one thread at a time and its replies keep the order of its requests.
+struct server
+{ map<string, served_model*> models;
+  chrono::steady_clock::time_point started;
+
+  mutex lock;
+  condition_variable readable;
+  queue<connection*> ready; // connections with input, waiting for a handler
+  vector<connection*> handled; // connections to poll again
+  int wake[2]; // written by handlers to make the accepting thread poll the handled connections
+  bool done;
+};
+
+namespace
+{ volatile sig_atomic_t stop_requested = 0;
+  void handle_stop(int) { stop_requested = 1; }
+}
+
+void load_models(server& s, const string& file)
+{ ifstream in(file.c_str());
+  if (!in.is_open())
+    THROW("can't open models file " << file);
+
+  string line;
+  while (getline(in, line))
+  { size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == string::npos || line[begin] == '#')
+      continue;
+    size_t end = line.find_first_of(" \t\r", begin);
+    string id = line.substr(begin, end - begin);
+    string args = end == string::npos ? "" : line.substr(end);
+    if (s.models.count(id))
+      THROW("model id " << id << " appears twice in " << file);
+
+    served_model* m = new served_model;
+    m->id = id;
+    m->requests = 0;
+    m->total_us = 0.;
+    m->max_us = 0.;
+    m->all = initialize(args + " --no_stdin --quiet");
+    m->all->random_state = rand48_state(); // as seeded by initialize
+    s.models[id] = m;
+    cerr << "serving model " << id << ":" << args << endl;
+  }
+  if (s.models.empty())
+    THROW("no models in " << file);
+}
+
+void send_line(int fd, const string& s)
+{ if (io_buf::write_file_or_socket(fd, s.c_str(), s.size()) != (ssize_t)s.size())
+    cerr << "write error: " << strerror(errno) << endl;
+}
+
+string stats_line(server& s, served_model& m)
+{ double seconds = chrono::duration<double>(chrono::steady_clock::now() - s.started).count();
+  lock_guard<mutex> l(m.lock);
+  stringstream ss;
+  ss << m.id << ' ' << m.requests << ' ' << (seconds > 0. ? m.requests / seconds : 0.)
+     << ' ' << (m.requests ? m.total_us / m.requests : 0.) << ' ' << m.max_us << '\n';
+  return ss.str();
+}
+
+// The example is answered through the model's own finish_example, so the reply has exactly the
+// format --daemon would give for that model.
+void predict(served_model& m, int fd, char* example_line)
+{ lock_guard<mutex> l(m.lock);
+  vw& all = *m.all;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  use_rand48_state(&all.random_state);
+  all.final_prediction_sink.push_back(fd);
+  example* ec = nullptr;
+  try
+  { ec = read_example(all, example_line);
+    LEARNER::process_example(all, ec);
+  }
+  catch (exception& e)
+  { if (ec != nullptr && ec->in_use)
+      finish_example(all, ec);
+    all.final_prediction_sink.pop();
+    use_rand48_state(nullptr);
+    send_line(fd, string("error: ") + e.what() + "\n");
+    return;
+  }
+  all.final_prediction_sink.pop();
+  use_rand48_state(nullptr);
+
+  double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+  m.requests++;
+  m.total_us += us;
+  if (us > m.max_us)
+    m.max_us = us;
+}
+
+void handle_request(server& s, int fd, string& line)
+{ size_t end = line.find_first_of(" \t");
+  string id = line.substr(0, end);
+  if (id == "stats")
+  { string reply;
+    for (auto& m : s.models)
+      reply += stats_line(s, *m.second);
+    send_line(fd, reply + "\n");
+    return;
+  }
+
+  map<string, served_model*>::iterator m = s.models.find(id);
+  if (m == s.models.end())
+  { send_line(fd, "error: unknown model " + id + "\n");
+    return;
+  }
+  predict(*m->second, fd, end == string::npos ? &line[line.size()] : &line[end + 1]);
+}
+
+// answers the complete lines received, false once the client is gone
+bool handle_input(server& s, connection& c)
+{ char buf[1 << 16];
+  ssize_t r = recv(c.fd, buf, sizeof(buf), 0);
+  if (r <= 0)
+    return false;
+  c.pending.append(buf, r);
+
+  size_t begin = 0, newline;
+  while ((newline = c.pending.find('\n', begin)) != string::npos)
+  { string line = c.pending.substr(begin, newline - begin);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.resize(line.size() - 1);
+    begin = newline + 1;
+    if (!line.empty())
+      handle_request(s, c.fd, line);
+  }
+  c.pending.erase(0, begin);
+  return true;
+}
+
+void handle_connections(server& s)
+{ while (true)
+  { connection* c;
+    { unique_lock<mutex> l(s.lock);
+      s.readable.wait(l, [&s] { return !s.ready.empty() || s.done; });
+      if (s.done)
+        return;
+      c = s.ready.front();
+      s.ready.pop();
+    }
+    if (handle_input(s, *c))
+    { { lock_guard<mutex> l(s.lock);
+        s.handled.push_back(c);
+      }
+#ifndef _WIN32
+      char wake = 0;
+      if (write(s.wake[1], &wake, 1) < 0)
+        cerr << "write wake pipe: " << strerror(errno) << endl;
+#endif
+    }
+    else
+    { io_buf::close_file_or_socket(c->fd);
+      delete c;
+    }
+  }
+}
+
+int listen_on(uint16_t port, const string& port_file)
+{ int sock = (int)socket(PF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    THROWERRNO("socket");
+
+  int on = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(on)) < 0)
+    cerr << "setsockopt SO_REUSEADDR: " << strerror(errno) << endl;
+
+  sockaddr_in address;
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (::bind(sock, (sockaddr*)&address, sizeof(address)) < 0)
+    THROWERRNO("bind");
+  if (listen(sock, SOMAXCONN) < 0)
+    THROWERRNO("listen");
+
+  if (!port_file.empty())
+  { socklen_t address_size = sizeof(address);
+    if (getsockname(sock, (sockaddr*)&address, &address_size) < 0)
+      cerr << "getsockname: " << strerror(errno) << endl;
+    ofstream out(port_file.c_str());
+    if (!out.is_open())
+      THROW("error writing port file: " << port_file);
+    out << ntohs(address.sin_port) << endl;
+  }
+  return sock;
+}
+
+void serve(int argc, char* argv[])
+{ po::options_description opts("Serving options");
+  opts.add_options()
+  ("serve", po::value<string>()->required(), "file with one \"<id> <vw arguments>\" line per model")
+  ("port", po::value<size_t>()->default_value(26542), "port to listen on; 0 picks a free one")
+  ("port_file", po::value<string>(), "write the port to this file")
+  ("threads", po::value<size_t>()->default_value(max(thread::hardware_concurrency(), 1u)), "requests handled concurrently");
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(opts).run(), vm);
+  po::notify(vm);
+
+  server s;
+  s.done = false;
+#ifndef _WIN32
+  if (pipe(s.wake) < 0)
+    THROWERRNO("pipe");
+  fcntl(s.wake[0], F_SETFL, O_NONBLOCK);
+#endif
+  load_models(s, vm["serve"].as<string>());
+
+#ifdef _WIN32
+  WSAData wsaData;
+  WSAStartup(MAKEWORD(2,2), &wsaData);
+#else
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  int sock = listen_on((uint16_t)vm["port"].as<size_t>(), vm.count("port_file") ? vm["port_file"].as<string>() : "");
+
+#ifndef _WIN32
+  // Only the accepting thread sees SIGINT and SIGTERM, its poll() returns EINTR.
+  sigset_t stop_signals, old;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old);
+#endif
+  vector<thread> handlers;
+  for (size_t i = 0; i < max(vm["threads"].as<size_t>(), (size_t)1); i++)
+    handlers.push_back(thread(handle_connections, ref(s)));
+#ifndef _WIN32
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+#endif
+
+  s.started = chrono::steady_clock::now();
+  cerr << "serving " << s.models.size() << " models with " << handlers.size() << " threads" << endl;
+  map<int, connection*> idle; // polled by this thread
+  vector<pollfd> fds;
+  while (!stop_requested)
+  { fds.clear();
+    fds.push_back({ sock, POLLIN, 0 });
+#ifdef _WIN32
+    // no wake pipe: poll the handled connections again every few milliseconds
+    const int wait_ms = 5;
+#else
+    fds.push_back({ s.wake[0], POLLIN, 0 });
+    const int wait_ms = -1;
+#endif
+    for (auto& c : idle)
+      fds.push_back({ c.first, POLLIN, 0 });
+    if (poll(fds.data(), (unsigned long)fds.size(), wait_ms) < 0)
+    { if (errno == EINTR)
+        continue;
+      THROWERRNO("poll");
+    }
+
+    { lock_guard<mutex> l(s.lock);
+#ifndef _WIN32
+      char drained[256];
+      while (read(s.wake[0], drained, sizeof(drained)) > 0);
+#endif
+      for (connection* c : s.handled)
+        idle[c->fd] = c;
+      s.handled.clear();
+
+      for (pollfd& p : fds)
+        if (p.revents != 0 && idle.count(p.fd))
+        { s.ready.push(idle[p.fd]);
+          idle.erase(p.fd);
+          s.readable.notify_one();
+        }
+    }
+
+    if (fds[0].revents & POLLIN)
+    { sockaddr_in client_address;
+      socklen_t size = sizeof(client_address);
+      int fd = (int)accept(sock, (sockaddr*)&client_address, &size);
+      if (fd < 0)
+      { if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        THROWERRNO("accept");
+      }
+      idle[fd] = new connection{ fd, "" };
+    }
+  }
+
+  io_buf::close_file_or_socket(sock);
+  { lock_guard<mutex> l(s.lock);
+    s.done = true;
+  }
+  s.readable.notify_all();
+  for (thread& t : handlers)
+    t.join();
+  for (connection* c : s.handled)
+    idle[c->fd] = c;
+  for (; !s.ready.empty(); s.ready.pop())
+    idle[s.ready.front()->fd] = s.ready.front();
+  for (auto& c : idle)
+  { io_buf::close_file_or_socket(c.first);
+    delete c.second;
+  }
+#ifndef _WIN32
+  close(s.wake[0]);
+  close(s.wake[1]);
+#endif
+
+  cerr << "model requests qps mean_us max_us" << endl;
+  for (auto& m : s.models)
+  { cerr << stats_line(s, *m.second);
+    finish(*m.second->all);
+    delete m.second;
+  }
+}
+}
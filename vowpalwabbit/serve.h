@@ -0,0 +1,26 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+// vw --serve <models file>: several independent models behind one listening socket.
+//
+// Each line of the models file is "<id> <vw arguments>", e.g. "us -t -i us.model"; blank lines and
+// lines starting with '#' are skipped.  Every model is its own vw from VW::initialize, so models
+// may use different reductions, label types and -b.  Clients speak the text protocol of --daemon,
+// with the model id as the first word of each line:
+//
+//   <id> <example>   one example in vw text format; answered with one line in the prediction
+//                    format of that model (labeled examples also train unless the model has -t)
+//   stats            one line "<id> <requests> <qps> <mean us> <max us>" per model, then an
+//                    empty line
+//
+// Only single-line examples are supported.  Requests for one model are serialized, requests for
+// different models run concurrently on a pool of --threads connection handlers.  SIGINT or SIGTERM
+// stops the server, prints the per-model counters and finishes every model (saving -f if given).
+
+namespace VW
+{
+void serve(int argc, char* argv[]);
+}
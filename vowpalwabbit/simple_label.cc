@@ -120,7 +120,7 @@ void output_and_account_example(vw& all, example& ec)
     if (all.lda > 0)
       print_lda_result(all, f,ec.topic_predictions.begin(),0.,ec.tag);
     else
-      all.print(f, ec.pred.scalar, 0, ec.tag);
+      all.print(f, ec.pred.scalar, ec.partial_prediction, ec.tag); // binary sinks also get the raw prediction
   }
 
   print_update(all, ec);
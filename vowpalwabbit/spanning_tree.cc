@@ -17,6 +17,7 @@ license as described in the file LICENSE.
 #include <cmath>
 #include <map>
 #include <future>
+#include <ctime>
 
 using namespace std;
 
@@ -27,7 +28,9 @@ struct client
 
 struct partial
 { client* nodes;
+  size_t total;
   size_t filled;
+  time_t last_join; // when a node of this nonce last connected
 };
 
 static int socket_sort(const void* s1, const void* s2)
@@ -74,9 +77,92 @@ void fail_send(const socket_t fd, const void* buf, const int count)
     THROWERRNO("send: ");
 }
 
+void fail_recv(const socket_t fd, void* buf, const int count)
+{ if (recv(fd, (char*)buf, count, 0) != count)
+    THROWERRNO("recv: ");
+}
+
+// Waiting nodes never send anything, so a readable socket means the node went away.
+bool node_alive(const socket_t fd)
+{ fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+  timeval no_wait = { 0, 0 };
+  int ready = select((int)fd + 1, &fds, nullptr, nullptr, &no_wait);
+  if (ready == 0)
+    return true;
+  char c;
+  return ready > 0 && recv(fd, &c, 1, MSG_PEEK) > 0;
+}
+
+void drop_node(size_t nonce, partial& p, size_t id)
+{ cerr << "nonce " << nonce << ": node " << id << " went away, waiting for it to rejoin" << endl;
+  CLOSESOCK(p.nodes[id].socket);
+  p.nodes[id].client_ip = (uint32_t)-1;
+  p.filled--;
+}
+
+// drops every dead node of a waiting nodeset so restarted nodes can take their place
+void drop_dead_nodes(size_t nonce, partial& p)
+{ for (size_t i = 0; i < p.total; i++)
+    if (p.nodes[i].client_ip != (uint32_t)-1 && !node_alive(p.nodes[i].socket))
+      drop_node(nonce, p, i);
+}
+
+void release_nodeset(partial& p)
+{ for (size_t i = 0; i < p.total; i++)
+    if (p.nodes[i].client_ip != (uint32_t)-1)
+      CLOSESOCK(p.nodes[i].socket);
+  free(p.nodes);
+}
+
+void build_spanning_tree(partial& partial_nodeset)
+{ size_t total = partial_nodeset.total;
+  qsort(partial_nodeset.nodes, total, sizeof(client), socket_sort);
+
+  int* parent = (int*)calloc(total, sizeof(int));
+  uint16_t* kid_count = (uint16_t*)calloc(total, sizeof(uint16_t));
+  uint16_t* client_ports = (uint16_t*)calloc(total, sizeof(uint16_t));
+
+  try
+  { int root = build_tree(parent, kid_count, total, 0);
+    parent[root] = -1;
+
+    for (size_t i = 0; i < total; i++)
+    { fail_send(partial_nodeset.nodes[i].socket, &kid_count[i], sizeof(kid_count[i]));
+    }
+
+    for (size_t i = 0; i < total; i++)
+      fail_recv(partial_nodeset.nodes[i].socket, &client_ports[i], sizeof(client_ports[i]));
+    // all clients have bound to their ports.
+
+    for (size_t i = 0; i < total; i++)
+    { if (parent[i] >= 0)
+      { fail_send(partial_nodeset.nodes[i].socket, &partial_nodeset.nodes[parent[i]].client_ip, sizeof(partial_nodeset.nodes[parent[i]].client_ip));
+        fail_send(partial_nodeset.nodes[i].socket, &client_ports[parent[i]], sizeof(client_ports[parent[i]]));
+      }
+      else
+      { int bogus = -1;
+        uint32_t bogus2 = -1;
+        fail_send(partial_nodeset.nodes[i].socket, &bogus2, sizeof(bogus2));
+        fail_send(partial_nodeset.nodes[i].socket, &bogus, sizeof(bogus));
+      }
+    }
+  }
+  catch (VW::vw_exception& e)
+  { // a node died while the tree was handed out; closing all sockets makes the others fail fast
+    cerr << "building spanning tree failed: " << e.what() << endl;
+  }
+
+  release_nodeset(partial_nodeset);
+  free(client_ports);
+  free(parent);
+  free(kid_count);
+}
+
 namespace VW
 {
-SpanningTree::SpanningTree() : m_stop(false), port(26543), m_future(nullptr)
+SpanningTree::SpanningTree(size_t timeout, short unsigned int port) : m_stop(false), port(port), m_timeout(timeout), m_future(nullptr)
 {
 #ifdef _WIN32
   WSAData wsaData;
@@ -99,6 +185,15 @@ SpanningTree::SpanningTree() : m_stop(false), port(26543), m_future(nullptr)
   address.sin_port = htons(port);
   if (::bind(sock, (sockaddr*)&address, sizeof(address)) < 0)
     THROWERRNO("bind: ");
+
+  socklen_t address_size = sizeof(address);
+  if (getsockname(sock, (sockaddr*)&address, &address_size) < 0)
+    THROWERRNO("getsockname: ");
+  this->port = ntohs(address.sin_port);
+}
+
+short unsigned int SpanningTree::BoundPort()
+{ return port;
 }
 
 SpanningTree::~SpanningTree()
@@ -125,11 +220,39 @@ void SpanningTree::Stop()
   }
 }
 
+void SpanningTree::CheckWaiting(map<size_t, partial>& partial_nodesets)
+{ time_t now = time(nullptr);
+  for (auto it = partial_nodesets.begin(); it != partial_nodesets.end();)
+  { drop_dead_nodes(it->first, it->second);
+    if (m_timeout > 0 && (size_t)(now - it->second.last_join) > m_timeout)
+    { cerr << "nonce " << it->first << ": no node joined for " << m_timeout << " seconds, giving up on "
+           << it->second.filled << " waiting nodes" << endl;
+      release_nodeset(it->second);
+      it = partial_nodesets.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
 void SpanningTree::Run()
 { map<size_t, partial> partial_nodesets;
+  if (listen(sock, 1024) < 0)
+    THROWERRNO("listen: ");
+
   while (!m_stop)
-  { if (listen(sock, 1024) < 0)
-      THROWERRNO("listen: ");
+  { // wake up regularly to notice nodes that died while waiting for the others
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    timeval check_interval = { 1, 0 };
+    int ready = select((int)sock + 1, &fds, nullptr, nullptr, &check_interval);
+    if (ready < 0)
+      break;
+    if (ready == 0)
+    { CheckWaiting(partial_nodesets);
+      continue;
+    }
 
     sockaddr_in client_address;
     socklen_t size = sizeof(client_address);
@@ -144,6 +267,14 @@ void SpanningTree::Run()
       break;
     }
 
+    // a node that connects but stalls must not block everybody else
+#ifdef _WIN32
+    DWORD handshake_timeout = 10000;
+#else
+    timeval handshake_timeout = { 10, 0 };
+#endif
+    setsockopt(f, SOL_SOCKET, SO_RCVTIMEO, (char*)&handshake_timeout, sizeof(handshake_timeout));
+
     char dotted_quad[INET_ADDRSTRLEN];
     if (NULL == inet_ntop(AF_INET, &(client_address.sin_addr), dotted_quad, INET_ADDRSTRLEN))
       THROWERRNO("inet_ntop: ");
@@ -160,24 +291,27 @@ void SpanningTree::Run()
     size_t nonce = 0;
     if (recv(f, (char*)&nonce, sizeof(nonce), 0) != sizeof(nonce))
     { cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
-           << "): nonce read failed, exiting" << endl;
-      exit(1);
+           << "): nonce read failed, dropping connection" << endl;
+      CLOSESOCK(f);
+      continue;
     }
     else cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
                 << "): nonce=" << nonce << endl;
     size_t total = 0;
     if (recv(f, (char*)&total, sizeof(total), 0) != sizeof(total))
     { cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
-           << "): total node count read failed, exiting" << endl;
-      exit(1);
+           << "): total node count read failed, dropping connection" << endl;
+      CLOSESOCK(f);
+      continue;
     }
     else cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
                 << "): total=" << total << endl;
     size_t id = 0;
     if (recv(f, (char*)&id, sizeof(id), 0) != sizeof(id))
     { cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
-           << "): node id read failed, exiting" << endl;
-      exit(1);
+           << "): node id read failed, dropping connection" << endl;
+      CLOSESOCK(f);
+      continue;
     }
     else cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
                 << "): node id=" << id << endl;
@@ -194,6 +328,7 @@ void SpanningTree::Run()
     { partial_nodeset.nodes = (client*)calloc(total, sizeof(client));
       for (size_t i = 0; i < total; i++)
         partial_nodeset.nodes[i].client_ip = (uint32_t)-1;
+      partial_nodeset.total = total;
       partial_nodeset.filled = 0;
     }
     else
@@ -201,68 +336,53 @@ void SpanningTree::Run()
       partial_nodesets.erase(nonce);
     }
 
+    if (ok && total != partial_nodeset.total)
+    { cout << dotted_quad << "(" << hostname << ':' << ntohs(port)
+           << "): total=" << total << " does not match " << partial_nodeset.total << " of nonce " << nonce << endl;
+      ok = false;
+    }
+
+    // a restarted node may take the place of one whose connection died
+    if (ok && partial_nodeset.nodes[id].client_ip != (uint32_t)-1 && !node_alive(partial_nodeset.nodes[id].socket))
+      drop_node(nonce, partial_nodeset, id);
+
     if (ok && partial_nodeset.nodes[id].client_ip != (uint32_t)-1)
       ok = false;
-    fail_send(f, &ok, sizeof(ok));
+    if (send(f, (char*)&ok, sizeof(ok), 0) == -1)
+      ok = false;
 
     if (ok)
     { partial_nodeset.nodes[id].client_ip = client_address.sin_addr.s_addr;
       partial_nodeset.nodes[id].socket = f;
       partial_nodeset.filled++;
+      partial_nodeset.last_join = time(nullptr);
     }
-    if (partial_nodeset.filled != total) //Need to wait for more connections
+    else
+      CLOSESOCK(f);
+
+    if (partial_nodeset.filled == partial_nodeset.total)
+      drop_dead_nodes(nonce, partial_nodeset);
+
+    if (partial_nodeset.filled == 0)
+      free(partial_nodeset.nodes);
+    else if (partial_nodeset.filled != partial_nodeset.total) //Need to wait for more connections
     { partial_nodesets[nonce] = partial_nodeset;
-      for (size_t i = 0; i < total; i++)
+      for (size_t i = 0; i < partial_nodeset.total; i++)
       { if (partial_nodeset.nodes[i].client_ip == (uint32_t)-1)
         { cout << "nonce " << nonce
-               << " still waiting for " << (total - partial_nodeset.filled)
-               << " nodes out of " << total << " for example node " << i << endl;
+               << " still waiting for " << (partial_nodeset.total - partial_nodeset.filled)
+               << " nodes out of " << partial_nodeset.total << " for example node " << i << endl;
           break;
         }
       }
     }
-    else
-    { //Time to make the spanning tree
-      qsort(partial_nodeset.nodes, total, sizeof(client), socket_sort);
-
-      int* parent = (int*)calloc(total, sizeof(int));
-      uint16_t* kid_count = (uint16_t*)calloc(total, sizeof(uint16_t));
-
-      int root = build_tree(parent, kid_count, total, 0);
-      parent[root] = -1;
-
-      for (size_t i = 0; i < total; i++)
-      { fail_send(partial_nodeset.nodes[i].socket, &kid_count[i], sizeof(kid_count[i]));
-      }
-
-      uint16_t* client_ports = (uint16_t*)calloc(total, sizeof(uint16_t));
-
-      for (size_t i = 0; i < total; i++)
-      { int done = 0;
-        if (recv(partial_nodeset.nodes[i].socket, (char*)&(client_ports[i]), sizeof(client_ports[i]), 0) < (int) sizeof(client_ports[i]))
-          cerr << " Port read failed for node " << i << " read " << done << endl;
-      }// all clients have bound to their ports.
-
-      for (size_t i = 0; i < total; i++)
-      { if (parent[i] >= 0)
-        { fail_send(partial_nodeset.nodes[i].socket, &partial_nodeset.nodes[parent[i]].client_ip, sizeof(partial_nodeset.nodes[parent[i]].client_ip));
-          fail_send(partial_nodeset.nodes[i].socket, &client_ports[parent[i]], sizeof(client_ports[parent[i]]));
-        }
-        else
-        { int bogus = -1;
-          uint32_t bogus2 = -1;
-          fail_send(partial_nodeset.nodes[i].socket, &bogus2, sizeof(bogus2));
-          fail_send(partial_nodeset.nodes[i].socket, &bogus, sizeof(bogus));
-        }
-        CLOSESOCK(partial_nodeset.nodes[i].socket);
-      }
-      free(client_ports);
-      free(partial_nodeset.nodes);
-      free(parent);
-      free(kid_count);
-    }
+    else //Time to make the spanning tree
+      build_spanning_tree(partial_nodeset);
   }
 
+  for (auto& p : partial_nodesets)
+    release_nodeset(p.second);
+
 #ifdef _WIN32
   WSACleanup();
 #endif
@@ -36,6 +36,9 @@ typedef int socket_t;
 
 #include <future>
 #endif
+#include <map>
+
+struct partial;
 
 namespace VW
 {
@@ -46,14 +49,22 @@ private:
   socket_t sock;
   short unsigned int port;
 
+  // seconds a nonce may wait without any node joining before its nodes are released, 0 waits forever
+  size_t m_timeout;
+
   // future to signal end of thread running.
   // Need a pointer since C++/CLI doesn't like futures yet
   std::future<void>* m_future;
 
+  void CheckWaiting(std::map<size_t, partial>& partial_nodesets);
+
 public:
-  SpanningTree();
+  // port 0 lets the system pick a free port, see BoundPort()
+  SpanningTree(size_t timeout = 0, short unsigned int port = 26543);
   ~SpanningTree();
 
+  short unsigned int BoundPort();
+
   void Start();
   void Run();
   void Stop();
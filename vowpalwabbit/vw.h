@@ -29,6 +29,7 @@ namespace VW
 vw* initialize(string s, io_buf* model=nullptr);
 vw* initialize(int argc, char* argv[], io_buf* model=nullptr);
 vw* seed_vw_model(vw* vw_model, string extra_args);
+bool reload_model(vw& all);
 
 void cmd_string_replace_value( std::stringstream*& ss, string flag_to_replace, string new_value );
 